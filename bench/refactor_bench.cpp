@@ -0,0 +1,354 @@
+#include <benchmark/benchmark.h>
+
+#include "RefactorTool.h"
+
+#include "clang/Frontend/ASTUnit.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace
+{
+    // Размер синтетической TU: Classes классов в цепочках наследования глубины Depth,
+    // Overrides переопределяемых методов у каждого класса, Loops функций с range-for.
+    struct Scale
+    {
+        int Classes;
+        int Overrides;
+        int Loops;
+        static constexpr int Depth = 8;
+        static constexpr int ClassesPerNamespace = 64;
+
+        Scale(int Classes, int Overrides, int Loops) : Classes(Classes), Overrides(Overrides), Loops(Loops) {}
+        explicit Scale(const benchmark::State &State)
+            : Classes(State.range(0)), Overrides(State.range(1)), Loops(State.range(2)) {}
+
+        bool operator<(const Scale &Other) const
+        {
+            return std::tie(Classes, Overrides, Loops) < std::tie(Other.Classes, Other.Overrides, Other.Loops);
+        }
+    };
+
+    // Синтетическая TU без системных заголовков, чтобы время разбора определялось самим кодом:
+    // цепочки наследования с невиртуальными деструкторами и методами без override,
+    // шаблонные наследники, range-for с копированием тяжёлого элемента, всё по пространствам имён.
+    std::string generateTU(const Scale &S)
+    {
+        std::string Code;
+        llvm::raw_string_ostream OS(Code);
+        OS << "struct Heavy { int data[16]; Heavy(); Heavy(const Heavy &); };\n"
+              "template <class T> struct Vec { T *b, *e; T *begin() const { return b; } T *end() const { return e; } };\n";
+
+        for (int I = 0; I < S.Classes; ++I)
+        {
+            if (I % Scale::ClassesPerNamespace == 0)
+                OS << "namespace ns" << I / Scale::ClassesPerNamespace << " {\n";
+
+            int Level = I % Scale::Depth;
+            OS << "class C" << I;
+            if (Level)
+                OS << " : public C" << I - 1;
+            OS << " {\npublic:\n";
+            for (int M = 0; M < S.Overrides; ++M)
+                OS << (Level ? "    void" : "    virtual void") << " m" << M << "(int a = (1 + 2)) {}\n";
+            OS << "    ~C" << I << "() {}\n};\n";
+
+            if (Level == Scale::Depth - 1)
+                OS << "template <class T> class T" << I << " : public C" << I << " {\npublic:\n"
+                   << "    void m0(int a = (1 + 2)) {}\n    T value;\n};\n"
+                   << "template class T" << I << "<int>;\n";
+
+            if (I % Scale::ClassesPerNamespace == Scale::ClassesPerNamespace - 1 || I == S.Classes - 1)
+                OS << "} // namespace\n";
+        }
+
+        for (int L = 0; L < S.Loops; ++L)
+            OS << "int loop" << L << "(const Vec<Heavy> &v) {\n"
+               << "    int s = 0;\n    for (const Heavy h : v) s += h.data[0];\n    return s;\n}\n";
+        return Code;
+    }
+
+    // Синтетическая TU с тяжёлым инстанцированием: шаблон класса с невиртуальным деструктором,
+    // методами без override и range-for, а также шаблон функции с range-for, явно
+    // инстанцированные Instantiations раз. Каждое инстанцирование повторяет узлы шаблона.
+    std::string generateTemplateTU(int Instantiations)
+    {
+        std::string Code;
+        llvm::raw_string_ostream OS(Code);
+        OS << "struct Heavy { int data[16]; Heavy(); Heavy(const Heavy &); };\n"
+              "template <class T> struct Vec { T *b, *e; T *begin() const { return b; } T *end() const { return e; } };\n"
+              "struct Base { virtual ~Base() {} virtual void m0() {} virtual void m1() {} };\n"
+              "template <class T> struct Box : Base {\n"
+              "    void m0() {}\n    void m1() {}\n"
+              "    int sum(const Vec<Heavy> &v) { int s = 0; for (const Heavy h : v) s += h.data[0]; return s; }\n"
+              "    T value;\n};\n"
+              "template <class T> struct Holder { ~Holder() {} T value; };\n"
+              "template <class T> int loop(const Vec<Heavy> &v, T) {\n"
+              "    int s = 0;\n    for (const Heavy h : v) s += h.data[0];\n    return s;\n}\n";
+        for (int I = 0; I < Instantiations; ++I)
+            OS << "struct Tag" << I << " {};\n"
+               << "template struct Box<Tag" << I << ">;\n"
+               << "struct Use" << I << " : Holder<Tag" << I << "> {};\n"
+               << "template int loop(const Vec<Heavy> &, Tag" << I << ");\n";
+        return Code;
+    }
+
+    std::unique_ptr<ASTUnit> buildAST(const std::string &Code)
+    {
+        auto AST = tooling::buildASTFromCodeWithArgs(Code, {"-std=c++20"}, "input.cc");
+        // Замечания об исправлениях на каждой итерации только зашумили бы вывод.
+        AST->getDiagnostics().setClient(new IgnoringDiagConsumer(), /*ShouldOwnClient=*/true);
+        return AST;
+    }
+
+    // AST каждого масштаба строится один раз и переиспользуется всеми бенчмарками, кроме разбора.
+    ASTUnit &astFor(const Scale &S)
+    {
+        static std::map<Scale, std::unique_ptr<ASTUnit>> Cache;
+        auto &AST = Cache[S];
+        if (!AST)
+            AST = buildAST(generateTU(S));
+        return *AST;
+    }
+
+    ASTUnit &templateAstFor(int Instantiations)
+    {
+        static std::map<int, std::unique_ptr<ASTUnit>> Cache;
+        auto &AST = Cache[Instantiations];
+        if (!AST)
+            AST = buildAST(generateTemplateTU(Instantiations));
+        return *AST;
+    }
+
+    enum class Check
+    {
+        All,
+        NvDtor,
+        Override,
+        RangeFor
+    };
+
+    const char *checkName(Check Which)
+    {
+        switch (Which)
+        {
+        case Check::NvDtor:
+            return "nv-dtor";
+        case Check::Override:
+            return "override";
+        case Check::RangeFor:
+            return "range-for-copy";
+        case Check::All:
+            break;
+        }
+        return "";
+    }
+
+    void addMatchers(MatchFinder &Finder, Check Which, MatchFinder::MatchCallback *Callback)
+    {
+        if (Which == Check::All || Which == Check::NvDtor)
+            Finder.addMatcher(NvDtorMatcher(), Callback);
+        if (Which == Check::All || Which == Check::Override)
+            Finder.addMatcher(NoOverrideMatcher(), Callback);
+        if (Which == Check::All || Which == Check::RangeFor)
+            Finder.addMatcher(NoRefVarInRangeLoopMatcher(), Callback);
+    }
+
+    class CountingCallback : public MatchFinder::MatchCallback
+    {
+    public:
+        void run(const MatchFinder::MatchResult &) override { ++Matches; }
+        int64_t Matches = 0;
+    };
+
+    const std::vector<std::vector<int64_t>> Scales = {{256, 4, 256}, {2048, 8, 2048}};
+
+    void applyScales(benchmark::internal::Benchmark *B)
+    {
+        B->ArgNames({"classes", "overrides", "loops"});
+        for (const auto &Args : Scales)
+            B->Args(Args);
+        B->Unit(benchmark::kMillisecond);
+    }
+} // namespace
+
+// Разбор: препроцессор, парсер и Sema до готового ASTContext.
+static void BM_Parse(benchmark::State &State)
+{
+    std::string Code = generateTU(Scale(State));
+    for (auto _ : State)
+    {
+        auto AST = tooling::buildASTFromCodeWithArgs(Code, {"-std=c++20"}, "input.cc");
+        benchmark::DoNotOptimize(AST.get());
+    }
+    State.SetBytesProcessed(State.iterations() * Code.size());
+}
+BENCHMARK(BM_Parse)->Apply(applyScales);
+
+// Поиск совпадений без обработки: стоимость обхода AST и самих матчеров.
+static void BM_Match(benchmark::State &State, Check Which)
+{
+    auto &AST = astFor(Scale(State));
+    int64_t Matches = 0;
+    for (auto _ : State)
+    {
+        CountingCallback Counter;
+        MatchFinder Finder;
+        addMatchers(Finder, Which, &Counter);
+        Finder.matchAST(AST.getASTContext());
+        Matches = Counter.Matches;
+    }
+    State.counters["matches"] = Matches;
+}
+BENCHMARK_CAPTURE(BM_Match, all, Check::All)->Apply(applyScales);
+BENCHMARK_CAPTURE(BM_Match, nv_dtor, Check::NvDtor)->Apply(applyScales);
+BENCHMARK_CAPTURE(BM_Match, override, Check::Override)->Apply(applyScales);
+BENCHMARK_CAPTURE(BM_Match, range_for, Check::RangeFor)->Apply(applyScales);
+
+// Поиск с обработкой одной или всех проверок: подготовка (индекс иерархии для nv-dtor),
+// вычисление мест вставки и правки в Rewriter. Остальные проверки не создаются.
+static void BM_Rewrite(benchmark::State &State, Check Which)
+{
+    auto &AST = astFor(Scale(State));
+    RefactorOptions Options;
+    if (Which != Check::All)
+        Options.Checks = {checkName(Which)};
+    size_t EditCount = 0;
+    for (auto _ : State)
+    {
+        Rewriter Rewrite(AST.getSourceManager(), AST.getLangOpts());
+        std::vector<tooling::Replacement> Edits;
+        ComplexConsumer Consumer(Rewrite, Edits, Options);
+        Consumer.HandleTranslationUnit(AST.getASTContext());
+        EditCount = Edits.size();
+    }
+    State.counters["edits"] = EditCount;
+}
+BENCHMARK_CAPTURE(BM_Rewrite, all, Check::All)->Apply(applyScales);
+BENCHMARK_CAPTURE(BM_Rewrite, nv_dtor, Check::NvDtor)->Apply(applyScales);
+BENCHMARK_CAPTURE(BM_Rewrite, override, Check::Override)->Apply(applyScales);
+BENCHMARK_CAPTURE(BM_Rewrite, range_for, Check::RangeFor)->Apply(applyScales);
+
+// Стоимость от числа включённых проверок (--checks): первые N из range-for-copy, override, nv-dtor.
+// N = 0 - обход AST не выполняется вовсе.
+static void BM_EnabledChecks(benchmark::State &State)
+{
+    auto &AST = astFor(Scale(256, 4, 256));
+    const char *Order[] = {"range-for-copy", "override", "nv-dtor"};
+    RefactorOptions Options;
+    Options.Checks.assign(Order, Order + State.range(0));
+    // Пустой список означает все проверки, поэтому N = 0 задаётся несуществующим именем.
+    if (Options.Checks.empty())
+        Options.Checks = {"none"};
+    for (auto _ : State)
+    {
+        Rewriter Rewrite(AST.getSourceManager(), AST.getLangOpts());
+        std::vector<tooling::Replacement> Edits;
+        ComplexConsumer Consumer(Rewrite, Edits, Options);
+        Consumer.HandleTranslationUnit(AST.getASTContext());
+        benchmark::DoNotOptimize(Edits.data());
+    }
+}
+BENCHMARK(BM_EnabledChecks)->ArgName("checks")->DenseRange(0, 3)->Unit(benchmark::kMillisecond);
+
+// ComplexConsumer целиком на готовом AST: индекс иерархии и все три матчера.
+static void BM_ComplexConsumer(benchmark::State &State)
+{
+    auto &AST = astFor(Scale(State));
+    for (auto _ : State)
+    {
+        Rewriter Rewrite(AST.getSourceManager(), AST.getLangOpts());
+        std::vector<tooling::Replacement> Edits;
+        ComplexConsumer Consumer(Rewrite, Edits);
+        Consumer.HandleTranslationUnit(AST.getASTContext());
+        benchmark::DoNotOptimize(Edits.data());
+    }
+}
+BENCHMARK(BM_ComplexConsumer)->Apply(applyScales);
+
+// Все проверки на TU с тяжёлым инстанцированием: обход каждого инстанцирования (as_is) против
+// только написанного кода (--skip-instantiations). matches - совпадения, переданные проверкам,
+// edits - сделанные правки (в обоих режимах одинаковые).
+static void BM_Instantiations(benchmark::State &State, bool Skip)
+{
+    auto &AST = templateAstFor(State.range(0));
+    RefactorOptions Options;
+    Options.SkipInstantiations = Skip;
+
+    // Совпадения считаются отдельным прогоном: профилирование матчеров исказило бы время.
+    TUProfile Profile;
+    {
+        Rewriter Rewrite(AST.getSourceManager(), AST.getLangOpts());
+        std::vector<tooling::Replacement> Edits;
+        ComplexConsumer Consumer(Rewrite, Edits, Options, &Profile);
+        Consumer.HandleTranslationUnit(AST.getASTContext());
+    }
+    int64_t Matches = 0;
+    for (const auto &Entry : Profile.Handlers)
+        Matches += Entry.second.Calls;
+
+    size_t EditCount = 0;
+    for (auto _ : State)
+    {
+        Rewriter Rewrite(AST.getSourceManager(), AST.getLangOpts());
+        std::vector<tooling::Replacement> Edits;
+        ComplexConsumer Consumer(Rewrite, Edits, Options);
+        Consumer.HandleTranslationUnit(AST.getASTContext());
+        EditCount = Edits.size();
+    }
+    State.counters["matches"] = Matches;
+    State.counters["edits"] = EditCount;
+}
+BENCHMARK_CAPTURE(BM_Instantiations, as_is, false)
+    ->ArgName("instantiations")
+    ->Arg(64)
+    ->Arg(512)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Instantiations, spelled, true)
+    ->ArgName("instantiations")
+    ->Arg(64)
+    ->Arg(512)
+    ->Unit(benchmark::kMillisecond);
+
+// Запись результата: сборка итогового буфера из Rewriter и вывод во временный файл.
+static void BM_Write(benchmark::State &State)
+{
+    auto &AST = astFor(Scale(State));
+    Rewriter Rewrite(AST.getSourceManager(), AST.getLangOpts());
+    std::vector<tooling::Replacement> Edits;
+    ComplexConsumer Consumer(Rewrite, Edits);
+    Consumer.HandleTranslationUnit(AST.getASTContext());
+    FileID Main = AST.getSourceManager().getMainFileID();
+
+    llvm::SmallString<128> Path;
+    if (llvm::sys::fs::createTemporaryFile("refactor_bench", "cc", Path))
+    {
+        State.SkipWithError("cannot create temporary file");
+        return;
+    }
+    for (auto _ : State)
+    {
+        const auto *Buffer = Rewrite.getRewriteBufferFor(Main);
+        if (auto Err = llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                                           {
+                                               Buffer->write(OS);
+                                               return llvm::Error::success(); }))
+        {
+            State.SkipWithError(llvm::toString(std::move(Err)).c_str());
+            break;
+        }
+    }
+    llvm::sys::fs::remove(Path);
+}
+BENCHMARK(BM_Write)->Apply(applyScales);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,26 @@
+#pragma once
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// Потокобезопасная запись результатов рефакторинга на диск.
+// Каждая TU отдаёт сюда итоговое содержимое изменённых файлов, а писатель
+// гарантирует, что один и тот же файл не будет записан несколькими потоками одновременно.
+class ChangesWriter
+{
+public:
+    // Записывает Content в файл FilePath (путь должен быть абсолютным).
+    // Повторная запись того же файла пропускается; если содержимое отличается
+    // от уже записанного, выводится предупреждение. Возвращает false при ошибке записи.
+    bool submit(llvm::StringRef FilePath, llvm::StringRef Content);
+
+    // Количество файлов, записанных на диск.
+    unsigned writtenFiles() const;
+
+private:
+    mutable std::mutex Mutex;
+    llvm::StringMap<uint64_t> Written; // путь -> хэш записанного содержимого
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/DeclCXX.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+
+// Обратный индекс иерархии классов одной TU: база -> прямые наследники.
+// Строится одним рекурсивным обходом до запуска матчеров, поэтому учитывает
+// классы в пространствах имён, вложенные и локальные классы.
+// Ключ - каноническое объявление CXXRecordDecl.
+class ClassHierarchyIndex
+{
+public:
+    // Обходит всю TU и заполняет индекс. Предыдущее содержимое сбрасывается.
+    // Обход учитывает ASTContext::getTraversalScope, поэтому вызывается до её ограничения.
+    void build(clang::ASTContext &Context);
+
+    // Есть ли у класса хотя бы один прямой наследник в TU. O(1).
+    bool hasDerived(const clang::CXXRecordDecl *Base) const;
+
+    // Прямые наследники класса (пустой список, если их нет).
+    llvm::ArrayRef<const clang::CXXRecordDecl *> derived(const clang::CXXRecordDecl *Base) const;
+
+    // Вызывает CB(Base, Derived) для каждого ребра индекса (порядок не определён).
+    template <typename Callback>
+    void forEachEdge(Callback &&CB) const
+    {
+        for (const auto &Entry : DerivedByBase)
+            for (const auto *Derived : Entry.second)
+                CB(Entry.first, Derived);
+    }
+
+    // Добавляет ребро Base -> Derived (используется обходом, но доступно и снаружи).
+    void addEdge(const clang::CXXRecordDecl *Base, const clang::CXXRecordDecl *Derived);
+
+private:
+    llvm::DenseMap<const clang::CXXRecordDecl *, llvm::SmallVector<const clang::CXXRecordDecl *, 2>> DerivedByBase;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class ChangesWriter;
+
+// Результат объединения правок нескольких TU.
+struct MergedEdits
+{
+    // Правки без повторов, отсортированы по файлу и смещению.
+    std::vector<clang::tooling::Replacement> Edits;
+    // Сколько одинаковых правок (файл, смещение, длина, текст) отброшено.
+    unsigned Duplicates = 0;
+    // Пары конфликтующих правок: первая оставлена, вторая отброшена.
+    std::vector<std::pair<clang::tooling::Replacement, clang::tooling::Replacement>> Conflicts;
+};
+
+// Объединяет правки: повторы схлопываются, пересекающиеся правки и разные вставки
+// в одно место считаются конфликтом. Результат не зависит от порядка входа.
+MergedEdits mergeEdits(std::vector<clang::tooling::Replacement> All);
+
+// Печатает конфликтующие правки: какая оставлена, какая отброшена.
+void reportConflicts(const MergedEdits &Merged, llvm::raw_ostream &OS);
+
+// Применяет правки к файлам на диске: каждый файл читается и записывается один раз.
+bool applyEdits(llvm::ArrayRef<clang::tooling::Replacement> Edits, ChangesWriter &Writer);
+
+// Записывает правки в YAML-формате clang-apply-replacements.
+// MainSourceFile - TU, к которой относятся правки (пусто для объединённых правок запуска).
+llvm::Error exportFixes(llvm::StringRef Path, llvm::ArrayRef<clang::tooling::Replacement> Edits,
+                        llvm::StringRef MainSourceFile = "");
+
+// Читает правки из YAML, записанного exportFixes.
+llvm::Expected<std::vector<clang::tooling::Replacement>> importFixes(llvm::StringRef Path);
+
+// Потокобезопасный сборщик правок всех TU (пути файлов абсолютные).
+class EditCollector
+{
+public:
+    void add(llvm::ArrayRef<clang::tooling::Replacement> Edits);
+    MergedEdits merge() const;
+    // Все правки без точных повторов, в порядке mergeEdits. Конфликты не разрешаются:
+    // так выгрузка шарда (--shard) сохраняет всё, что нужно для объединения в merge.
+    std::vector<clang::tooling::Replacement> unique() const;
+
+private:
+    mutable std::mutex Mutex;
+    std::vector<clang::tooling::Replacement> All;
+};
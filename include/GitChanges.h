@@ -0,0 +1,12 @@
+#pragma once
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+// Файлы, изменённые с ревизии Rev в репозитории git, которому принадлежит WorkDir:
+// коммиты после Rev, индекс и рабочее дерево, а также новые неотслеживаемые файлы
+// (без игнорируемых). Удалённые и переименованные файлы входят под старым и новым именем.
+// Пути абсолютные. Использует программу git из PATH.
+llvm::Expected<std::vector<std::string>> gitChangedFiles(llvm::StringRef Rev, llvm::StringRef WorkDir = ".");
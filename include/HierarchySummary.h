@@ -0,0 +1,64 @@
+#pragma once
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/CachedHashString.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Межмодульный (cross-TU) анализ иерархии классов в два этапа.
+//
+// Фаза 1 (map): для каждой TU сохраняется компактная сводка рёбер
+// (USR базы, USR наследника) в двоичном файле *.rths.
+// Фаза 2 (reduce): сводки всех TU отображаются в память и объединяются
+// в GlobalHierarchy, после чего handle_nv_dtor видит наследников из других TU.
+//
+// Формат файла (все числа - uint32 little-endian):
+//   "RTHS" | версия | NumStrings | NumEdges
+//   StringOffsets[NumStrings + 1]   - смещения строк в блоке строк
+//   Edges[NumEdges][2]              - индексы строк (база, наследник)
+//   блок строк (USR без разделителей)
+
+// Расширение файлов сводок.
+inline constexpr llvm::StringLiteral HierarchySummaryExt = ".rths";
+
+// Записывает сводку рёбер в Path. Рёбра сортируются и дедуплицируются,
+// поэтому файл не зависит от порядка обхода AST.
+llvm::Error writeHierarchySummary(llvm::StringRef Path,
+                                  std::vector<std::pair<std::string, std::string>> Edges);
+
+// Объединённая иерархия всех TU. Хранит только ссылки на строки внутри
+// отображённых в память файлов сводок, без копирования USR.
+class GlobalHierarchy
+{
+public:
+    // Загружает один файл сводки.
+    llvm::Error load(llvm::StringRef Path);
+    // Загружает все файлы *.rths из каталога.
+    llvm::Error loadDirectory(llvm::StringRef Dir);
+
+    // Есть ли у класса с данным USR наследник хотя бы в одной TU.
+    bool hasDerived(llvm::StringRef BaseUSR) const;
+
+    size_t summaryCount() const { return Buffers.size(); }
+    size_t edgeCount() const { return Edges; }
+    size_t baseCount() const { return Bases.size(); }
+    // Хэш содержимого всех загруженных сводок (для ключей кэша результатов).
+    uint64_t fingerprint() const { return Fingerprint; }
+
+private:
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> Buffers;
+    llvm::DenseSet<llvm::CachedHashStringRef> Bases;
+    size_t Edges = 0;
+    uint64_t Fingerprint = 0;
+};
+
+// Фабрика действий фазы 1: строит индекс иерархии TU и пишет сводку
+// в OutputDir, не изменяя исходники.
+std::unique_ptr<clang::tooling::FrontendActionFactory>
+newHierarchySummaryActionFactory(llvm::StringRef OutputDir);
@@ -0,0 +1,31 @@
+#pragma once
+#include "RefactorTool.h"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+// Результат рефакторинга буфера.
+struct RefactoredCode
+{
+    std::string Code;                               // исходный буфер со всеми правками главного файла
+    std::vector<clang::tooling::Replacement> Edits; // правки главного файла, смещения - в исходном буфере
+};
+
+// Рефакторинг кода из памяти, без чтения и записи главного файла на диске: Code подставляется
+// под именем FileName в оверлейную ФС поверх реальной (заголовки читаются с диска как обычно).
+// Args - флаги компилятора, как у runToolOnCodeWithArgs; относительный FileName и пути во флагах
+// отсчитываются от текущего каталога. Правки в заголовках (HeaderFilter) в результат не входят.
+// Ошибка - TU не разобралась, в сообщении диагностика компилятора.
+llvm::Expected<RefactoredCode> refactorCode(llvm::StringRef Code, llvm::ArrayRef<std::string> Args,
+                                            llvm::StringRef FileName, const RefactorOptions &Options = {});
+
+// То же с командой компиляции файла из базы: флаги и рабочий каталог берутся из Command,
+// содержимое Command.Filename - из Code.
+llvm::Expected<RefactoredCode> refactorCode(llvm::StringRef Code, const clang::tooling::CompileCommand &Command,
+                                            const RefactorOptions &Options = {});
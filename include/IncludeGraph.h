@@ -0,0 +1,48 @@
+#pragma once
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Сохраняемый между запусками граф включений: для каждой разобранной TU - хэш команды
+// компиляции и все прочитанные ею файлы. По нему --changed-since находит TU, затронутые
+// изменёнными заголовками, без разбора остальных.
+//
+// Формат файла - JSON, пути интернированы:
+//   {"version": 1, "files": [<путь>...],
+//    "tus": [{"file": <индекс>, "command": "<хэш>", "includes": [<индекс>...]}...]}
+// Пути канонические (realpath), чтобы совпадать с путями из git.
+class IncludeGraph
+{
+public:
+    // Загружает граф. Отсутствующий файл - пустой граф, а не ошибка.
+    static llvm::Expected<IncludeGraph> load(llvm::StringRef Path);
+    llvm::Error save(llvm::StringRef Path) const;
+
+    // Заменяет запись TU. Includes - главный и все включённые файлы (TUResult::Dependencies).
+    void update(llvm::StringRef TU, llvm::ArrayRef<clang::tooling::CompileCommand> Commands,
+                llvm::ArrayRef<std::string> Includes);
+
+    // TU из Candidates, результат которых мог измениться из-за файлов Changed: изменён сам
+    // главный файл или включённый им файл, изменилась команда компиляции или TU нет в графе.
+    // Порядок и пути Candidates сохраняются.
+    std::vector<std::string> affected(llvm::ArrayRef<std::string> Candidates, llvm::ArrayRef<std::string> Changed,
+                                      const clang::tooling::CompilationDatabase &Compilations) const;
+
+    size_t size() const { return TUs.size(); }
+
+    // Канонический путь файла; для удалённого файла - канонический путь каталога и имя.
+    static std::string canonicalPath(llvm::StringRef Path);
+
+private:
+    struct Entry
+    {
+        std::string Command;
+        std::vector<std::string> Includes;
+    };
+    std::map<std::string, Entry> TUs; // упорядочены - файл не зависит от порядка разбора
+};
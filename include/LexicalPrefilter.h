@@ -0,0 +1,33 @@
+#pragma once
+#include "llvm/ADT/StringRef.h"
+
+#include "RefactorTool.h"
+
+#include <optional>
+
+// Предварительный фильтр TU (--prefilter): по сырому тексту главного файла, без препроцессора
+// и разбора, определяет TU, в которых ни одна включённая проверка не может сделать правку.
+//
+// Фильтр консервативен: лексема, найденная в комментарии или строке, тоже считается найденной,
+// а при склейке строк через '\' и триграфах файл не фильтруется. Правки вне главного файла
+// (--header-filter) фильтр не видит, поэтому с ним отключается. Предполагается, что ключевые
+// слова и '~' из списков проверок (RefactorCheck.h, CheckInfo::AnyOfTokens) записаны в главном
+// файле явно, а не получаются из макросов, определённых в заголовках.
+class LexicalPrefilter
+{
+public:
+    explicit LexicalPrefilter(const RefactorOptions &Options);
+
+    // false - фильтр к этим настройкам неприменим и не пропускает ничего.
+    bool enabled() const { return Enabled; }
+
+    // Может ли TU с таким главным файлом дать правку.
+    bool mayProduceEdits(llvm::StringRef MainContent) const;
+
+    // То же для файла на диске: содержимое отображается в память. nullopt - файл не прочитан.
+    std::optional<bool> mayProduceEditsInFile(llvm::StringRef Path) const;
+
+private:
+    bool Enabled = true;
+    std::vector<llvm::StringRef> Tokens; // любая из них - TU нужно разбирать
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Кэш предкомпилированных преамбул (PCH).
+//
+// Преамбула - начальный блок #include/#define главного файла (Lexer::ComputePreamble).
+// TU с одинаковой преамбулой, флагами и каталогом используют один PCH: он подключается
+// через -include-pch, а повторные #include в самом файле отсекаются include guard'ами.
+// PCH хранятся в каталоге кэша и переиспользуются как внутри запуска, так и между запусками.
+// Если с PCH TU не разбирается (заголовок без guard'ов, устаревший PCH), вызывающий
+// повторяет разбор без него и помечает PCH недействительным.
+class PreambleCache
+{
+public:
+    struct Preamble
+    {
+        std::string Key;
+        std::string PchPath;
+        // Дополнительные аргументы для TU: -include-pch и путь поиска заголовков.
+        std::vector<std::string> ExtraArgs;
+        // Все файлы, вошедшие в PCH (для кэша результатов), абсолютные пути.
+        std::vector<std::string> Dependencies;
+        // Время сборки PCH - оценка того, сколько стоит разбор преамбулы.
+        double BuildSeconds = 0;
+        // PCH собран этим вызовом get().
+        bool JustBuilt = false;
+    };
+
+    explicit PreambleCache(std::string Dir);
+
+    // PCH для преамбулы TU (собирается при первом обращении). nullopt - у файла нет
+    // преамбулы, у TU несколько команд компиляции или PCH собрать не удалось.
+    std::optional<Preamble> get(const clang::tooling::CompileCommand &Command,
+                                llvm::StringRef MainPath, llvm::StringRef MainContent);
+
+    // TU с этим PCH не разобралась: файлы PCH удаляются, в этом запуске он больше не используется.
+    void invalidate(const Preamble &P);
+
+    // TU успешно разобрана с PCH: учитываем сэкономленное время разбора преамбулы.
+    void noteUsed(const Preamble &P);
+
+    unsigned built() const { return Built; }
+    unsigned reused() const { return Reused; }
+    unsigned failed() const { return Failed; }
+    double buildSeconds() const { return BuildMicros / 1e6; }
+    double savedSeconds() const { return SavedMicros / 1e6; }
+
+private:
+    struct Entry
+    {
+        std::mutex Mutex;
+        bool Done = false;
+        std::optional<Preamble> Value;
+    };
+
+    std::optional<Preamble> load(const std::string &Key) const;
+    std::optional<Preamble> build(const clang::tooling::CompileCommand &Command, const std::string &Key,
+                                  const std::vector<std::string> &Args, llvm::StringRef MainDir,
+                                  llvm::StringRef PreambleText);
+    std::string pathFor(llvm::StringRef Key, llvm::StringRef Ext) const;
+
+    std::string Dir;
+    std::mutex Mutex;
+    std::map<std::string, std::shared_ptr<Entry>> Entries;
+    std::atomic<unsigned> Built{0};
+    std::atomic<unsigned> Reused{0};
+    std::atomic<unsigned> Failed{0};
+    std::atomic<uint64_t> BuildMicros{0};
+    std::atomic<uint64_t> SavedMicros{0};
+};
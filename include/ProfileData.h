@@ -0,0 +1,68 @@
+#pragma once
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Счётчики функций из профиля выполнения (--profile-data). Поддерживаются текстовые форматы
+// llvm-profdata:
+//   - инструментальный (llvm-profdata merge -text): счётчик функции - максимальный из её
+//     счётчиков, то есть число выполнений самого горячего блока;
+//   - сэмплирующий (llvm-profgen по perf, create_llvm_prof, llvm-profdata merge -sample -text):
+//     счётчик - общее число сэмплов функции "имя:всего:вход".
+// Ключ - искажённое (mangled) имя; суффиксы вида ".llvm.123" и префикс "файл;" локальных
+// функций отбрасываются, счётчики совпавших имён складываются.
+class FunctionProfile
+{
+public:
+    static llvm::Expected<FunctionProfile> load(llvm::StringRef Path);
+
+    // Счётчик функции; 0 - функции нет в профиле.
+    uint64_t count(llvm::StringRef MangledName) const { return Counts.lookup(MangledName); }
+
+    size_t size() const { return Counts.size(); }
+
+    // Хэш содержимого профиля (входит в отпечаток настроек для кэша результатов).
+    uint64_t fingerprint() const { return Fingerprint; }
+
+private:
+    void add(llvm::StringRef Name, uint64_t Count);
+
+    llvm::StringMap<uint64_t> Counts;
+    uint64_t Fingerprint = 0;
+};
+
+// Кандидат на правку range-for-copy с оценкой по профилю.
+struct RankedEdit
+{
+    std::string File; // абсолютный путь
+    unsigned Line = 0;
+    unsigned Column = 0;
+    std::string Function;    // искажённое имя объемлющей функции
+    uint64_t Count = 0;      // счётчик функции из профиля
+    uint64_t ElementSize = 0; // sizeof копируемого элемента, байт
+    uint64_t Iterations = 0; // число итераций, если известно по типу диапазона; 0 - неизвестно
+    bool Applied = false;
+
+    // Оценка выигрыша: счётчик функции x байты копии за итерацию x итерации (неизвестно - 1).
+    double score() const;
+};
+
+// Кандидаты всех TU запуска (--profile-ranking). Потокобезопасный.
+class EditRanking
+{
+public:
+    void add(RankedEdit Edit);
+
+    // Пишет кандидатов по убыванию оценки, по одному в строке, поля через табуляцию.
+    // Кандидат из заголовка, видимый нескольким TU, выводится один раз.
+    llvm::Error write(llvm::StringRef Path) const;
+
+private:
+    mutable std::mutex Mutex;
+    std::vector<RankedEdit> Edits;
+};
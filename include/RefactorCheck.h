@@ -0,0 +1,60 @@
+#pragma once
+#include "clang/AST/ASTContext.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class RefactorHandler;
+
+// Проверка рефакторинга: свои матчеры и обработка их совпадений.
+// Проверка хранит только своё состояние, общие средства правки (какие файлы можно менять,
+// вставка без повторов, учёт правок) даёт RefactorHandler. getID() - имя проверки
+// в --checks, в профиле и в отчётах.
+class RefactorCheck : public clang::ast_matchers::MatchFinder::MatchCallback
+{
+public:
+    explicit RefactorCheck(RefactorHandler &Handler) : Handler(Handler) {}
+
+    // Регистрирует матчеры проверки с this в качестве обработчика.
+    virtual void registerMatchers(clang::ast_matchers::MatchFinder &Finder) = 0;
+
+    // Вызывается с готовым AST до запуска матчеров, например для построения индексов.
+    virtual void prepare(clang::ASTContext &Context) {}
+
+    // Обработка одного совпадения.
+    virtual void check(const clang::ast_matchers::MatchFinder::MatchResult &Result) = 0;
+
+    // Передаёт совпадение в check, учитывая время обработки в профиле.
+    void run(const clang::ast_matchers::MatchFinder::MatchResult &Result) final;
+
+protected:
+    // Режим обхода матчеров проверки: с RefactorOptions::SkipInstantiations - только написанный код.
+    clang::TraversalKind traversalKind() const;
+
+    RefactorHandler &Handler;
+};
+
+// Запись реестра проверок. Новая проверка - класс RefactorCheck и одна строка в реестре.
+struct CheckInfo
+{
+    llvm::StringLiteral Name;
+    llvm::StringLiteral Description;
+    std::unique_ptr<RefactorCheck> (*Create)(RefactorHandler &Handler);
+    // Лексемы для предварительного фильтра (--prefilter): правка в главном файле возможна,
+    // только если в нём есть хотя бы одна из них. Пустой список - фильтр к проверке неприменим.
+    llvm::ArrayRef<llvm::StringLiteral> AnyOfTokens = {};
+    // Проверка включается только явным --checks: её правки рискованнее остальных.
+    bool OptIn = false;
+};
+
+// Все известные проверки в порядке их регистрации в MatchFinder.
+llvm::ArrayRef<CheckInfo> registeredChecks();
+
+// Разбирает список проверок через запятую. Пустой список - все проверки, кроме OptIn.
+// Возвращает ошибку для неизвестного имени.
+llvm::Expected<std::vector<std::string>> parseCheckList(llvm::StringRef List);
@@ -0,0 +1,37 @@
+#pragma once
+#include "clang/Frontend/FrontendAction.h"
+
+#include "RefactorTool.h"
+
+#include <string>
+#include <vector>
+
+// Проверки как плагин clang: выполняются в том же процессе, что и обычная компиляция,
+// после основного действия (генерации объектного файла), на уже готовом AST.
+// Исходники и объектный файл не меняются, правки пишутся YAML-файлом для clang-apply-replacements.
+//
+//   clang++ -fplugin=librefactor.so -fplugin-arg-refactor-fixes-dir=fixes -c a.cpp
+//
+// Аргументы (-fplugin-arg-refactor-<key>=<value>):
+//   fixes=<file>          - файл правок этой TU;
+//   fixes-dir=<dir>       - каталог правок: файл на каждую TU с именем по пути главного файла;
+//   checks=<list>         - включённые проверки, как --checks;
+//   header-filter=<regex> - заголовки, которые тоже можно править, как --header-filter.
+// Без fixes и fixes-dir правки пишутся рядом с объектным файлом: <output>.fixes.yaml.
+class RefactorPluginAction : public clang::PluginASTAction
+{
+public:
+    bool ParseArgs(const clang::CompilerInstance &CI, const std::vector<std::string> &Args) override;
+    ActionType getActionType() override { return AddAfterMainAction; }
+
+protected:
+    std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, llvm::StringRef InFile) override;
+
+private:
+    // Куда записать правки TU. Пусто - правки некуда записать (например, вывод в stdout).
+    std::string fixesPathFor(clang::CompilerInstance &CI, llvm::StringRef MainFile) const;
+
+    RefactorOptions Options;
+    std::string FixesPath;
+    std::string FixesDir;
+};
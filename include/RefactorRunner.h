@@ -0,0 +1,119 @@
+#pragma once
+#include "RefactorTool.h"
+#include "PreambleCache.h"
+#include "ResultCache.h"
+
+#include "clang/Basic/FileManager.h"
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Параметры запуска рефакторинга по набору TU.
+struct RunOptions
+{
+    // Количество рабочих потоков. 0 - по числу доступных ядер.
+    unsigned Jobs = 1;
+
+    // Фаза 1 межмодульного анализа: если задан каталог, вместо рефакторинга
+    // для каждой TU сохраняется сводка иерархии классов.
+    std::string EmitHierarchyDir;
+
+    // Каталог кэша результатов. Если задан, неизменённые TU не разбираются,
+    // а их сохранённые правки применяются повторно.
+    std::string CacheDir;
+
+    // Каталог кэша преамбул. Если задан, общий начальный блок #include каждой TU
+    // собирается в PCH один раз и подключается к остальным TU с той же преамбулой.
+    std::string PreambleDir;
+
+    // Если задан, в этот файл пишется JSON-отчёт профилирования по TU и суммарно.
+    std::string ProfileReport;
+
+    // Если задан, в этот файл пишется JSON-статистика по TU для мониторинга: время фаз,
+    // пиковая память, размер AST, совпадения и сделанные/пропущенные правки.
+    std::string StatsReport;
+
+    // Если задан, правки не применяются, а выгружаются в YAML для clang-apply-replacements.
+    std::string ExportFixes;
+
+    // С ExportFixes: выгрузить правки без разрешения конфликтов (только без точных повторов).
+    // Так выгружает шард (--shard), конфликты между шардами разрешает подкоманда merge.
+    bool ExportUnmerged = false;
+
+    // Не разбирать TU, в главном файле которых нет лексем, нужных включённым проверкам
+    // (см. LexicalPrefilter). Не используется с --header-filter.
+    bool Prefilter = false;
+
+    // Если задан, граф включений (IncludeGraph) загружается из этого файла, записи
+    // разобранных TU обновляются, и граф сохраняется обратно (для --changed-since).
+    std::string IncludeGraphPath;
+
+    // Если задан, кандидаты range-for-copy с оценками по профилю (RefactorOptions::ProfileData)
+    // пишутся в этот файл по убыванию оценки. Кэш результатов при этом не используется:
+    // попадание в кэш не восстанавливает кандидатов.
+    std::string ProfileRanking;
+
+    // Если задан, время разбора каждой TU сохраняется в этот файл (TimingHistory), и следующие
+    // параллельные запуски начинают с самых долгих TU. Без истории порядок оценивается
+    // по размеру главного файла и числу #include.
+    std::string TimingsFile;
+
+    // Настройки, передаваемые в каждое CodeRefactorAction.
+    RefactorOptions Refactor;
+};
+
+// Запускает CodeRefactorAction для каждого файла из SourcePaths.
+// Каждый поток разбирает свои TU со своими Rewriter и RefactorHandler. При нескольких потоках
+// TU берутся из общей очереди, упорядоченной от самых дорогих (scheduleLargestFirst):
+// освободившийся поток сразу забирает следующую, и самая большая TU не оказывается последней.
+// Правки всех TU объединяются (с удалением повторов по файлу и смещению)
+// и в конце записываются через общий ChangesWriter - каждый файл один раз.
+// Результат совпадает с последовательным запуском ClangTool::run.
+// Возвращает 0 при успехе, 1 если хотя бы одна TU завершилась с ошибкой.
+int runRefactor(const clang::tooling::CompilationDatabase &Compilations,
+                llvm::ArrayRef<std::string> SourcePaths,
+                const RunOptions &Options);
+
+// Состояние, переживающее несколько запусков: кэши результатов и преамбул и FileManager'ы
+// рабочих потоков с уже прочитанными заголовками. runRefactor создаёт сессию на один запуск,
+// сервер (--serve) держит одну сессию на всё время работы.
+class RefactorSession
+{
+public:
+    RefactorSession(const clang::tooling::CompilationDatabase &Compilations, RunOptions Options);
+
+    // То же, что runRefactor, но с сохранением состояния между вызовами.
+    // Вызовы run, refresh и warmPreamble не должны выполняться одновременно.
+    int run(llvm::ArrayRef<std::string> SourcePaths);
+
+    // Сверяет файлы, закэшированные в FileManager'ах, с диском. FileManager, видевший
+    // изменённый файл, сбрасывается, иначе он отдал бы устаревший размер и содержимое.
+    // Возвращает изменённые файлы (абсолютные пути, без повторов).
+    std::vector<std::string> refresh();
+
+    // Заранее собирает PCH преамбулы файла, если кэш преамбул включён.
+    void warmPreamble(llvm::StringRef File);
+
+private:
+    struct WorkerState
+    {
+        // Собственная физическая ФС у каждого потока: ClangTool меняет рабочий каталог
+        // на каталог компиляции, и реальная ФС сделала бы это для всего процесса.
+        llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS;
+        llvm::IntrusiveRefCntPtr<clang::FileManager> Files; // пустой - создаётся заново
+    };
+
+    const clang::tooling::CompilationDatabase &Compilations;
+    RunOptions Options;
+    std::optional<ResultCache> Cache;
+    std::optional<PreambleCache> Preambles;
+    std::shared_ptr<clang::PCHContainerOperations> PCHContainerOps;
+    std::vector<WorkerState> Workers;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include "RefactorRunner.h"
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+// Режим сервера (--serve): процесс остаётся запущенным и принимает запросы через
+// Unix-сокет, сохраняя между ними базу компиляции, FileManager'ы и PCH преамбул
+// (одна RefactorSession на всё время работы). Запросы обрабатываются по одному.
+//
+// Протокол построчный, одна строка JSON на запрос и на ответ:
+//   {"files": ["/abs/a.cpp", ...]} -> {"status": 0, "files": 1, "milliseconds": 12.5}
+//   {"command": "shutdown"}         -> {"status": 0}, после чего сервер завершается
+// Ошибка разбора запроса: {"status": 1, "error": "..."}.
+//
+// С Watch фоновый поток раз в WatchIntervalMs сверяет прочитанные файлы с диском:
+// изменённые сбрасываются из FileManager'ов, а для изменённых главных файлов
+// заранее пересобирается PCH преамбулы, чтобы следующий запрос не ждал разбора заголовков.
+// Для файлов из Warmup PCH преамбул собираются сразу после запуска.
+// Строка запроса должна прийти за ReadTimeoutMs после подключения, иначе соединение закрывается.
+int serveRefactor(const clang::tooling::CompilationDatabase &Compilations, const RunOptions &Options,
+                  llvm::StringRef SocketPath, llvm::ArrayRef<std::string> Warmup, bool Watch,
+                  unsigned WatchIntervalMs = 500, unsigned ReadTimeoutMs = 10000);
+
+// Клиент (--connect): отправляет серверу файлы (пути делаются абсолютными) и печатает ответ.
+// Возвращает status из ответа, 1 - если сервер недоступен.
+int requestRefactor(llvm::StringRef SocketPath, llvm::ArrayRef<std::string> Files);
+
+// Просит сервер завершиться. Возвращает 0, если сервер подтвердил.
+int requestShutdown(llvm::StringRef SocketPath);
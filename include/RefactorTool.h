@@ -7,54 +7,237 @@
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Rewrite/Core/Rewriter.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/Timer.h"
 
-#include <unordered_set>
+#include "ProfileData.h"
+#include "RefactorCheck.h"
+#include "TUProfile.h"
 
-class RefactorHandler : public clang::ast_matchers::MatchFinder::MatchCallback
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ChangesWriter;
+class GlobalHierarchy;
+class FunctionProfile;
+
+namespace details
+{
+    // Абсолютный путь к файлу TU без '.' и '..'.
+    std::string GetAbsolutePath(clang::FileManager &FM, llvm::StringRef Path);
+} // end namespace details
+
+// Заголовки, правки в которых уже вычислила какая-либо TU (режим --header-filter).
+// Общий для всех TU запуска, потокобезопасный. Заголовок занимается только TU, разобранной
+// без ошибок: пока её результат не принят, другие TU вычисляют те же правки, а повторы
+// схлопывает слияние.
+class HeaderClaims
 {
 public:
-    explicit RefactorHandler(clang::Rewriter &Rewrite) : Rewrite(Rewrite) {}
-    // Метод run вызывается для каждого совпадения с матчем.
-    // Мы проверяем тип совпадения по bind-именам и применяем рефакторинг.
-    virtual void run(const clang::ast_matchers::MatchFinder::MatchResult &Result) override;
+    // true, если заголовок занят TU, результат которой уже принят.
+    bool claimed(llvm::StringRef Path);
+    // Занимает заголовки TU, результат которой принят (TUResult::ClaimedHeaders).
+    void commit(llvm::ArrayRef<std::string> Paths);
 
 private:
-    // 1. Невиртуальные деструкторы
-    void handle_nv_dtor(const clang::CXXDestructorDecl *Dtor,
-                        clang::DiagnosticsEngine &Diag,
-                        clang::SourceManager &SM);
+    std::mutex Mutex;
+    llvm::StringSet<> Claimed;
+};
+
+// Общие для всех TU настройки рефакторинга.
+struct RefactorOptions
+{
+    // Иерархия классов, объединённая по всем TU (фаза 2 режима --hierarchy).
+    // Если задана, virtual добавляется и тогда, когда наследники есть только в других TU.
+    const GlobalHierarchy *Hierarchy = nullptr;
+
+    // Регулярное выражение для путей заголовков, которые тоже можно править.
+    // Пустое - правится только главный файл TU.
+    std::string HeaderFilter;
+
+    // Если задан, правки в заголовке, не зависящие от TU (override, range-for),
+    // вычисляет только первая успешно разобранная TU, включившая его. Правки virtual зависят от
+    // наследников, видимых в TU, поэтому считаются везде и схлопываются при слиянии.
+    HeaderClaims *Claims = nullptr;
+
+    // Замерять время фаз, матчеров и обработчиков в TUResult::Profile (--profile).
+    // На правки не влияет и в отпечаток не входит.
+    bool Profile = false;
+
+    // С Profile: считать объявления и операторы AST отдельным обходом (--stats).
+    bool CountNodes = false;
 
-    // 2. Методы без override
-    void handle_miss_override(const clang::CXXMethodDecl *Method,
-                              clang::DiagnosticsEngine &Diag,
-                              clang::SourceManager &SM);
+    // Сопоставлять матчеры только с объявлениями верхнего уровня из файлов, которые можно править
+    // (главный файл и заголовки под HeaderFilter), а не со всем AST вместе со стандартной
+    // библиотекой (--limit-traversal). Индекс иерархии классов по-прежнему строится по всей TU.
+    bool LimitTraversal = false;
 
-    // 3. range-for без &
-    void handle_crange_for(const clang::VarDecl *LoopVar,
-                           clang::DiagnosticsEngine &Diag,
-                           clang::SourceManager &SM);
+    // Не сопоставлять матчеры с инстанцированиями шаблонов и неявным кодом
+    // (TK_IgnoreUnlessSpelledInSource, --skip-instantiations): каждый написанный в коде узел
+    // проверяется один раз, а не по разу на инстанцирование. Правки те же - они и так делаются
+    // в тексте шаблона.
+    bool SkipInstantiations = false;
+
+    // range-for-copy и value-param: копия тривиально копируемого типа размером не больше этого
+    // числа байт считается дешёвой и не заменяется ссылкой (--copy-threshold).
+    uint64_t CopyThreshold = 16;
+
+    // Счётчики функций из профиля выполнения (--profile-data). Кандидаты range-for-copy получают
+    // оценку: счётчик объемлющей функции x sizeof элемента x число итераций (если известно).
+    const FunctionProfile *ProfileData = nullptr;
+
+    // С ProfileData: правки range-for-copy с оценкой ниже порога не делаются (--profile-threshold).
+    uint64_t ProfileThreshold = 0;
+
+    // Если задан, сюда собираются все кандидаты range-for-copy с оценками (--profile-ranking).
+    // На правки не влияет и в отпечаток не входит.
+    EditRanking *Ranking = nullptr;
+
+    // Имена включённых проверок (--checks). Пустой список - все зарегистрированные, кроме
+    // включаемых только явно (CheckInfo::OptIn).
+    std::vector<std::string> Checks;
+    bool isEnabled(llvm::StringRef Check) const;
+
+    // Отпечаток настроек, влияющих на результат (входит в ключ кэша результатов).
+    uint64_t fingerprint() const;
+};
+
+// Результат обработки одной TU: сделанные правки и файлы, от которых он зависит.
+struct TUResult
+{
+    std::vector<clang::tooling::Replacement> Edits; // пути файлов абсолютные
+    std::vector<std::string> Dependencies;          // главный и все включённые файлы, абсолютные пути
+    TUProfile Profile;                              // заполняется при RefactorOptions::Profile
+    // Заголовки, правки в которых TU вычислила за всех (RefactorOptions::Claims). Вызывающий
+    // занимает их через HeaderClaims::commit, только если принимает результат TU.
+    std::vector<std::string> ClaimedHeaders;
+    // Кандидаты --profile-ranking (RefactorOptions::Ranking): добавляются в общий список тоже
+    // только для принятой TU, иначе неудачная попытка оставила бы в нём повторы и сирот.
+    std::vector<RankedEdit> Ranked;
+};
+
+// Общие для всех проверок TU средства правки: какие файлы можно менять,
+// вставка без повторов и учёт сделанных правок.
+class RefactorHandler
+{
+public:
+    // Если задан Profile, время обработки совпадений каждой проверкой прибавляется к нему.
+    // Если задан Result, в него откладывается то, что вызывающий применяет к общему состоянию
+    // запуска только для успешно разобранной TU; без него это применяется сразу.
+    RefactorHandler(clang::Rewriter &Rewrite, const RefactorOptions &Options,
+                    std::vector<clang::tooling::Replacement> &Edits, TUProfile *Profile = nullptr,
+                    TUResult *Result = nullptr);
+
+    const RefactorOptions &options() const { return Options; }
+
+    // Можно ли править файл, в котором находится Loc: главный файл TU или заголовок,
+    // подходящий под --header-filter. ContextFree - правка зависит только от содержимого
+    // файла, поэтому заголовок достаточно обработать в одной TU.
+    bool canRewrite(clang::SourceManager &SM, clang::SourceLocation Loc, bool ContextFree);
+
+    // Главный файл или заголовок под --header-filter, без учёта занятости заголовка другой TU
+    // и без записи в статистику пропусков. Для макросов проверяется место раскрытия.
+    bool isEditableFile(clang::SourceManager &SM, clang::SourceLocation Loc);
+
+    // Вставляет Text перед Loc и записывает правку. false - место уже изменено или не переписывается.
+    bool insertText(clang::SourceManager &SM, clang::SourceLocation Loc, llvm::StringRef Text);
+
+    // Передаёт кандидата в RefactorOptions::Ranking: через Result, если он задан, иначе сразу.
+    void rank(RankedEdit Edit);
+
+    // Учитывает в профиле правку, пропущенную по причине Reason. Всегда возвращает false.
+    bool skip(llvm::StringRef Reason);
+
+    // Выполняет Fn, учитывая время и число вызовов под именем Check (при профилировании).
+    template <typename Fn>
+    void timed(llvm::StringRef Check, Fn &&Handle)
+    {
+        if (!Profile)
+            return Handle();
+        auto &Stats = Profile->Handlers[Check.str()];
+        ++Stats.Calls;
+        ScopedTimer Timer(Stats.Seconds);
+        Handle();
+    }
 
 private:
+    bool matchesHeaderFilter(clang::SourceManager &SM, clang::FileID FID);
+
     clang::Rewriter &Rewrite;
-    std::unordered_set<unsigned> virtualDtorLocations; // Для хранения позиций деструкторов, к которым уже добавлен virtual
+    const RefactorOptions &Options;
+    std::vector<clang::tooling::Replacement> &Edits; // Все правки TU в порядке их внесения
+    std::set<std::pair<std::string, unsigned>> EditedLocations; // (файл, смещение) уже сделанных вставок
+    std::optional<llvm::Regex> HeaderFilter;
+    llvm::DenseMap<clang::FileID, bool> AllowedFiles;   // Кэш решения по заголовку
+    llvm::DenseMap<clang::FileID, bool> OwnedHeaders;   // Заголовки, занятые этой TU
+    TUProfile *Profile;
+    TUResult *Result;
 };
 
+// Матчеры проверок из RefactorChecks.cpp.
+// Вынесены в заголовок, чтобы бенчмарки могли запускать каждый из них отдельно.
+clang::ast_matchers::DeclarationMatcher NvDtorMatcher();                  // bind "nonVirtualDtor"
+clang::ast_matchers::DeclarationMatcher NoOverrideMatcher();              // bind "missingOverride"
+// Методы инстанцирований шаблонов классов, переопределяющие виртуальные. Для --skip-instantiations:
+// базу, зависящую от параметра шаблона, видно только в инстанцировании. bind "missingOverride".
+clang::ast_matchers::DeclarationMatcher NoOverrideInInstantiationMatcher();
+clang::ast_matchers::StatementMatcher NoRefVarInRangeLoopMatcher();      // bind "loopVar", "rangeFor"
+// Цикл for (i = 0; i < n; ++i) или range-for с безусловным push_back/emplace_back в локальный вектор.
+// bind "loop", "vector" и "tripCount" (n) либо "range".
+clang::ast_matchers::StatementMatcher VectorPushBackLoopMatcher();
+// Определение невиртуальной функции с параметром классового типа по значению. bind "function".
+clang::ast_matchers::DeclarationMatcher ValueParamFunctionMatcher();
+
 class ComplexConsumer : public clang::ASTConsumer
 {
 public:
     // Конструктор принимает Rewriter для изменения кода.
-    explicit ComplexConsumer(clang::Rewriter &Rewrite);
+    // Сделанные правки дописываются в Edits, замеры времени (если нужны) - в Profile,
+    // отложенное до принятия результата TU (см. RefactorHandler) - в Result.
+    ComplexConsumer(clang::Rewriter &Rewrite, std::vector<clang::tooling::Replacement> &Edits,
+                    RefactorOptions Options = {}, TUProfile *Profile = nullptr, TUResult *Result = nullptr);
+    // С RefactorOptions::LimitTraversal запоминает объявления верхнего уровня, разобранные в TU.
+    bool HandleTopLevelDecl(clang::DeclGroupRef Group) override;
     // Метод HandleTranslationUnit вызывается для каждого файла.
+    // Без включённых проверок AST не обходится вовсе.
     void HandleTranslationUnit(clang::ASTContext &Context) override;
 
 private:
-    RefactorHandler Handler;                 // Обработчик матчеров.
+    // Ограничивает обход матчеров объявлениями из файлов, которые можно править.
+    void limitTraversal(clang::ASTContext &Context);
+    // Запускает MatchFinder (и подсчёт узлов для --stats) в текущей области обхода.
+    void match(clang::ASTContext &Context);
+
+    RefactorOptions Options;
+    TUProfile *Profile;
+    std::chrono::steady_clock::time_point Created; // Создаётся до разбора TU: начало фазы parse.
+    double CreatedCpu;
+    RefactorHandler Handler;                 // Общий контекст правок для проверок.
+    std::vector<std::unique_ptr<RefactorCheck>> Checks; // Только включённые в Options.Checks.
+    llvm::StringMap<llvm::TimeRecord> MatcherTimes; // Заполняется MatchFinder при профилировании.
     clang::ast_matchers::MatchFinder Finder; // MatchFinder для поиска узлов AST.
+    std::vector<clang::Decl *> TopLevelDecls; // Только с LimitTraversal.
 };
 
 class CodeRefactorAction : public clang::ASTFrontendAction
 {
 public:
+    // С Writer итоговое содержимое файлов передаётся ему (используется при параллельном запуске).
+    // Если задан Result, в него дописываются правки и зависимости TU; без Writer файлы
+    // при этом не меняются - правками распоряжается вызывающий (например, --export-fixes).
+    // Без Writer и Result изменения сразу записываются через Rewriter::overwriteChangedFiles.
+    explicit CodeRefactorAction(ChangesWriter *Writer = nullptr, RefactorOptions Options = {},
+                                TUResult *Result = nullptr)
+        : Writer(Writer), Options(Options), Result(Result) {}
+
     // Returns our ASTConsumer per translation unit.
     virtual std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI, clang::StringRef file) override;
     virtual bool BeginSourceFileAction(clang::CompilerInstance &CI) override;
@@ -62,4 +245,23 @@ public:
 
 private:
     clang::Rewriter RewriterForCodeRefactor;
+    ChangesWriter *Writer;
+    RefactorOptions Options;
+    TUResult *Result;
+    std::vector<clang::tooling::Replacement> Edits;
+};
+
+// Фабрика действий, отдающих изменения общему ChangesWriter и/или в TUResult.
+class CodeRefactorActionFactory : public clang::tooling::FrontendActionFactory
+{
+public:
+    explicit CodeRefactorActionFactory(ChangesWriter *Writer, RefactorOptions Options = {},
+                                       TUResult *Result = nullptr)
+        : Writer(Writer), Options(Options), Result(Result) {}
+    std::unique_ptr<clang::FrontendAction> create() override;
+
+private:
+    ChangesWriter *Writer;
+    RefactorOptions Options;
+    TUResult *Result;
 };
\ No newline at end of file
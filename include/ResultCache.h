@@ -0,0 +1,48 @@
+#pragma once
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Дисковый кэш результатов рефакторинга, адресуемый по содержимому входов TU.
+//
+// Ключ - хэш команд компиляции, содержимого главного файла и отпечатка настроек.
+// Запись хранит список всех включённых файлов с хэшами их содержимого и правки,
+// сделанные RefactorHandler (в том числе пустой список). Запись считается
+// действительной, только если ни один из включённых файлов не изменился.
+class ResultCache
+{
+public:
+    explicit ResultCache(std::string Dir);
+
+    // Ключ TU. OptionsFingerprint отражает настройки, влияющие на результат.
+    static std::string computeKey(llvm::ArrayRef<clang::tooling::CompileCommand> Commands,
+                                  llvm::StringRef MainFileContent,
+                                  uint64_t OptionsFingerprint);
+
+    // Возвращает сохранённые правки, если запись есть и все зависимости не изменились.
+    // Обновляет счётчики попаданий и промахов.
+    std::optional<std::vector<clang::tooling::Replacement>> lookup(llvm::StringRef Key);
+
+    // Сохраняет результат TU. Dependencies - абсолютные пути всех прочитанных файлов.
+    // Если задан MainFile, его хэш берётся из MainFileContent, а не с диска.
+    void store(llvm::StringRef Key, llvm::ArrayRef<std::string> Dependencies,
+               llvm::ArrayRef<clang::tooling::Replacement> Edits,
+               llvm::StringRef MainFile = {}, llvm::StringRef MainFileContent = {});
+
+    unsigned hits() const { return Hits; }
+    unsigned misses() const { return Misses; }
+
+private:
+    std::string entryPath(llvm::StringRef Key) const;
+
+    std::string Dir;
+    std::atomic<unsigned> Hits{0};
+    std::atomic<unsigned> Misses{0};
+};
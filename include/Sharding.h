@@ -0,0 +1,28 @@
+#pragma once
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <string>
+#include <vector>
+
+// Номер шарда и их общее число (--shard=i/N, 0 <= i < N).
+struct ShardSpec
+{
+    unsigned Index = 0;
+    unsigned Count = 1;
+};
+
+// Разбирает "i/N".
+llvm::Expected<ShardSpec> parseShardSpec(llvm::StringRef Spec);
+
+// Файлы, достающиеся шарду. Распределение по размеру главного файла (самый большой -
+// в наименее загруженный шард) и зависит только от набора путей и размеров файлов,
+// поэтому все процессы по одному дереву получают непересекающиеся шарды, покрывающие весь список.
+std::vector<std::string> selectShard(llvm::ArrayRef<std::string> Files, ShardSpec Shard);
+
+// Подкоманда merge: объединяет YAML-выгрузки шардов так же, как правки TU объединяются
+// в одном процессе - повторы схлопываются, о конфликтах сообщается. Результат пишется в
+// Output (побайтно совпадает с --export-fixes однопроцессного запуска) и/или применяется к файлам.
+// Возвращает 0 при успехе.
+int mergeShardFixes(llvm::ArrayRef<std::string> Inputs, llvm::StringRef Output, bool Apply);
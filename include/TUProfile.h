@@ -0,0 +1,136 @@
+#pragma once
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm
+{
+    class raw_fd_ostream;
+}
+
+// Процессорное время текущего потока, в секундах.
+double threadCpuSeconds();
+
+// Пиковый размер резидентной памяти процесса (VmHWM), в байтах (0, если недоступно).
+// Это пик за всё время жизни процесса или с последнего resetPeakRSS.
+uint64_t peakRSSBytes();
+
+// Сбрасывает пик процесса до текущего RSS (Linux, /proc/self/clear_refs). false - не удалось.
+bool resetPeakRSS();
+
+// Профиль обработки одной TU (--profile, --stats). Время в секундах.
+struct TUProfile
+{
+    struct Phase
+    {
+        double Wall = 0; // настенное время
+        double Cpu = 0;  // процессорное время потока
+    };
+
+    struct HandlerStats
+    {
+        double Seconds = 0;
+        unsigned Calls = 0; // число совпадений, переданных проверке
+    };
+
+    std::string File;
+    // Состояние TU в отчёте --stats: parsed, cached (правки взяты из кэша) или failed.
+    std::string Status = "parsed";
+    Phase Parse;   // препроцессор, парсер и Sema
+    Phase Prepare; // подготовка проверок (например, индекс иерархии классов)
+    Phase Match;   // MatchFinder::matchAST целиком
+    Phase Flush;   // выгрузка правок Rewriter
+    // Матчер вместе с обработчиком, по данным MatchFinderOptions::CheckProfiling.
+    std::map<std::string, double> Matchers;
+    // Обработка совпадений по проверкам (имя из --checks).
+    std::map<std::string, HandlerStats> Handlers;
+
+    uint64_t PeakRSS = 0;       // байт, пик процесса к концу TU (см. RSSProbe)
+    uint64_t PeakRSSGrowth = 0; // байт, на сколько пик вырос за время TU
+    uint64_t Decls = 0;   // объявлений в AST, включая неявные и инстанцирования шаблонов
+    uint64_t Stmts = 0;   // операторов и выражений там же
+    unsigned EditsApplied = 0;
+    // Пропущенные правки по причинам: system_header, not_main_file, duplicate_location и т.д.
+    std::map<std::string, unsigned> EditsSkipped;
+
+    double total() const { return Parse.Wall + Prepare.Wall + Match.Wall + Flush.Wall; }
+};
+
+// Прибавляет время жизни объекта к Target (и процессорное время потока к Cpu, если задан).
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(double &Target, double *Cpu = nullptr)
+        : Target(Target), Cpu(Cpu), Start(std::chrono::steady_clock::now()), CpuStart(Cpu ? threadCpuSeconds() : 0)
+    {
+    }
+    explicit ScopedTimer(TUProfile::Phase &Phase) : ScopedTimer(Phase.Wall, &Phase.Cpu) {}
+    ~ScopedTimer()
+    {
+        Target += std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        if (Cpu)
+            *Cpu += threadCpuSeconds() - CpuStart;
+    }
+
+private:
+    double &Target;
+    double *Cpu;
+    std::chrono::steady_clock::time_point Start;
+    double CpuStart;
+};
+
+// Замер памяти на время обработки одной TU. С ResetPeak (при -j 1, когда TU в процессе одна)
+// пик сбрасывается до текущего RSS, и PeakRSS - пик именно этой TU. Без сброса пик общий для
+// процесса: PeakRSS - пик с начала запуска, а PeakRSSGrowth показывает, подняла ли его TU
+// (при -j больше 1 прирост делят TU, разбиравшиеся одновременно).
+class RSSProbe
+{
+public:
+    explicit RSSProbe(bool ResetPeak);
+    void finish(TUProfile &P) const;
+
+private:
+    uint64_t Baseline;
+};
+
+// Журнал --stats на время запуска (<отчёт>.partial): по строке JSON на начало разбора TU
+// ({"file", "status": "started"}) и на каждую завершённую TU - та же запись, что в
+// translation_units отчёта. Строка сразу сбрасывается в файл, поэтому если процесс убит
+// (например, по нехватке памяти), в журнале остаются готовые TU и TU, разбиравшиеся в этот момент.
+// После записи отчёта журнал удаляется.
+class StatsJournal
+{
+public:
+    static llvm::Expected<std::unique_ptr<StatsJournal>> create(llvm::StringRef ReportPath);
+    ~StatsJournal();
+
+    void started(llvm::StringRef File);
+    void finished(const TUProfile &P);
+    void remove();
+
+private:
+    StatsJournal(std::string Path, std::unique_ptr<llvm::raw_fd_ostream> OS);
+    void write(const std::string &Line);
+
+    std::string Path;
+    std::mutex Mutex;
+    std::unique_ptr<llvm::raw_fd_ostream> OS;
+};
+
+// Пишет JSON-отчёт: суммарное время по фазам, матчерам и обработчикам и профили TU.
+// Все списки отсортированы по убыванию стоимости.
+llvm::Error writeProfileReport(llvm::StringRef Path, std::vector<TUProfile> Profiles);
+
+// Пишет JSON-статистику для мониторинга (--stats): по каждой TU время фаз (настенное и
+// процессорное), пиковая память, размер AST, совпадения по проверкам, сделанные и
+// пропущенные правки с причинами, и итоги запуска. TU упорядочены по пути файла.
+// Duplicates и Conflicts - правки, отброшенные при объединении правок всех TU.
+llvm::Error writeStatsReport(llvm::StringRef Path, std::vector<TUProfile> Profiles, unsigned Duplicates,
+                             unsigned Conflicts);
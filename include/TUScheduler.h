@@ -0,0 +1,34 @@
+#pragma once
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+// Время разбора TU в прошлых запусках (--timings). Формат файла - JSON:
+//   {"version": 1, "tus": {"<абсолютный путь>": <секунды>, ...}}
+class TimingHistory
+{
+public:
+    // Отсутствующий файл - пустая история, а не ошибка.
+    static llvm::Expected<TimingHistory> load(llvm::StringRef Path);
+    llvm::Error save(llvm::StringRef Path) const;
+
+    // Учитывает новое время TU: среднее с прошлым, чтобы единичный выброс не ломал порядок.
+    void record(llvm::StringRef File, double Seconds);
+    std::optional<double> seconds(llvm::StringRef File) const;
+
+    size_t size() const { return Seconds.size(); }
+
+private:
+    llvm::StringMap<double> Seconds;
+};
+
+// Порядок обработки TU для параллельного запуска: по убыванию оценки стоимости (LPT).
+// Стоимость - время из History, а для TU без истории - размер главного файла плюс
+// условный вес каждого #include, переведённый в секунды по TU, для которых известно и то и другое.
+// При равной оценке порядок - по пути. Ключи History - абсолютные пути.
+std::vector<std::string> scheduleLargestFirst(llvm::ArrayRef<std::string> Files, const TimingHistory *History);
@@ -0,0 +1,39 @@
+#include "ChangesWriter.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+bool ChangesWriter::submit(llvm::StringRef FilePath, llvm::StringRef Content)
+{
+    uint64_t Hash = llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Content));
+
+    std::lock_guard<std::mutex> Lock(Mutex);
+    auto [It, Inserted] = Written.try_emplace(FilePath, Hash);
+    if (!Inserted)
+    {
+        // Файл уже записан другой TU. Одинаковый результат - норма (файл указан дважды),
+        // разный - конфликт, оставляем первый вариант, как и при последовательном запуске.
+        if (It->second != Hash)
+            llvm::errs() << "Conflicting changes for " << FilePath << ", keeping the first result.\n";
+        return true;
+    }
+
+    if (auto Err = llvm::writeToOutput(FilePath, [&](llvm::raw_ostream &OS)
+                                       {
+                                           OS << Content;
+                                           return llvm::Error::success(); }))
+    {
+        llvm::errs() << "Error writing " << FilePath << ": " << llvm::toString(std::move(Err)) << "\n";
+        Written.erase(It);
+        return false;
+    }
+    return true;
+}
+
+unsigned ChangesWriter::writtenFiles() const
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Written.size();
+}
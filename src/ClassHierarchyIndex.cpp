@@ -0,0 +1,55 @@
+#include "ClassHierarchyIndex.h"
+
+#include "clang/AST/RecursiveASTVisitor.h"
+
+using namespace clang;
+
+namespace
+{
+    class HierarchyCollector : public RecursiveASTVisitor<HierarchyCollector>
+    {
+    public:
+        explicit HierarchyCollector(ClassHierarchyIndex &Index) : Index(Index) {}
+
+        bool VisitCXXRecordDecl(CXXRecordDecl *RD)
+        {
+            if (!RD->isThisDeclarationADefinition())
+                return true;
+
+            for (const auto &Base : RD->bases())
+                if (const auto *BaseDecl = Base.getType()->getAsCXXRecordDecl())
+                    Index.addEdge(BaseDecl, RD);
+            return true;
+        }
+
+    private:
+        ClassHierarchyIndex &Index;
+    };
+} // namespace
+
+void ClassHierarchyIndex::build(ASTContext &Context)
+{
+    DerivedByBase.clear();
+    HierarchyCollector Collector(*this);
+    Collector.TraverseDecl(Context.getTranslationUnitDecl());
+}
+
+void ClassHierarchyIndex::addEdge(const CXXRecordDecl *Base, const CXXRecordDecl *Derived)
+{
+    DerivedByBase[Base->getCanonicalDecl()].push_back(Derived->getCanonicalDecl());
+}
+
+bool ClassHierarchyIndex::hasDerived(const CXXRecordDecl *Base) const
+{
+    return Base && DerivedByBase.count(Base->getCanonicalDecl());
+}
+
+llvm::ArrayRef<const CXXRecordDecl *> ClassHierarchyIndex::derived(const CXXRecordDecl *Base) const
+{
+    if (!Base)
+        return {};
+    auto It = DerivedByBase.find(Base->getCanonicalDecl());
+    if (It == DerivedByBase.end())
+        return {};
+    return It->second;
+}
@@ -0,0 +1,150 @@
+#include "EditCollector.h"
+#include "ChangesWriter.h"
+
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <tuple>
+
+using namespace clang::tooling;
+
+namespace
+{
+    auto key(const Replacement &R)
+    {
+        return std::make_tuple(R.getFilePath(), R.getOffset(), R.getLength(), R.getReplacementText());
+    }
+} // namespace
+
+MergedEdits mergeEdits(std::vector<Replacement> All)
+{
+    llvm::sort(All, [](const Replacement &L, const Replacement &R)
+               { return key(L) < key(R); });
+
+    MergedEdits Result;
+    unsigned FileEnd = 0; // конец самой дальней уже принятой правки в текущем файле
+    for (auto &Edit : All)
+    {
+        if (!Result.Edits.empty())
+        {
+            const auto &Prev = Result.Edits.back();
+            if (key(Prev) == key(Edit))
+            {
+                ++Result.Duplicates;
+                continue;
+            }
+            // Правки отсортированы по файлу и смещению: вставки в одну точку и
+            // пересечения с уже принятыми правками этого файла - конфликт.
+            if (Prev.getFilePath() == Edit.getFilePath())
+            {
+                if (Prev.getOffset() == Edit.getOffset() || Edit.getOffset() < FileEnd)
+                {
+                    Result.Conflicts.emplace_back(Prev, Edit);
+                    continue;
+                }
+            }
+            else
+                FileEnd = 0;
+        }
+        FileEnd = std::max(FileEnd, Edit.getOffset() + Edit.getLength());
+        Result.Edits.push_back(std::move(Edit));
+    }
+    return Result;
+}
+
+void reportConflicts(const MergedEdits &Merged, llvm::raw_ostream &OS)
+{
+    for (const auto &[Kept, Dropped] : Merged.Conflicts)
+        OS << "Conflicting edits in " << Kept.getFilePath() << " at offset " << Dropped.getOffset()
+           << ": keeping '" << Kept.getReplacementText() << "', dropping '" << Dropped.getReplacementText() << "'\n";
+}
+
+bool applyEdits(llvm::ArrayRef<Replacement> Edits, ChangesWriter &Writer)
+{
+    llvm::StringMap<Replacements> ByFile;
+    for (const auto &Edit : Edits)
+        if (auto Err = ByFile[Edit.getFilePath()].add(Edit))
+        {
+            llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+            return false;
+        }
+
+    bool Ok = true;
+    for (const auto &Entry : ByFile)
+    {
+        auto Path = Entry.first();
+        auto Buf = llvm::MemoryBuffer::getFile(Path);
+        if (!Buf)
+        {
+            llvm::errs() << "Cannot read " << Path << ": " << Buf.getError().message() << "\n";
+            Ok = false;
+            continue;
+        }
+        auto Code = applyAllReplacements((*Buf)->getBuffer(), Entry.second);
+        if (!Code)
+        {
+            llvm::errs() << llvm::toString(Code.takeError()) << "\n";
+            Ok = false;
+            continue;
+        }
+        Ok &= Writer.submit(Path, *Code);
+    }
+    return Ok;
+}
+
+llvm::Error exportFixes(llvm::StringRef Path, llvm::ArrayRef<Replacement> Edits, llvm::StringRef MainSourceFile)
+{
+    TranslationUnitReplacements TUR;
+    TUR.MainSourceFile = MainSourceFile.str();
+    TUR.Replacements.assign(Edits.begin(), Edits.end());
+    return llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                               {
+                                   llvm::yaml::Output YAML(OS);
+                                   YAML << TUR;
+                                   return llvm::Error::success(); });
+}
+
+llvm::Expected<std::vector<Replacement>> importFixes(llvm::StringRef Path)
+{
+    auto Buf = llvm::MemoryBuffer::getFile(Path);
+    if (!Buf)
+        return llvm::errorCodeToError(Buf.getError());
+    TranslationUnitReplacements TUR;
+    llvm::yaml::Input YAML((*Buf)->getBuffer());
+    YAML >> TUR;
+    if (YAML.error())
+        return llvm::errorCodeToError(YAML.error());
+    return std::move(TUR.Replacements);
+}
+
+void EditCollector::add(llvm::ArrayRef<Replacement> Edits)
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    All.insert(All.end(), Edits.begin(), Edits.end());
+}
+
+MergedEdits EditCollector::merge() const
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return mergeEdits(All);
+}
+
+std::vector<Replacement> EditCollector::unique() const
+{
+    std::vector<Replacement> Result;
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Result = All;
+    }
+    llvm::sort(Result, [](const Replacement &L, const Replacement &R)
+               { return key(L) < key(R); });
+    Result.erase(std::unique(Result.begin(), Result.end(), [](const Replacement &L, const Replacement &R)
+                             { return key(L) == key(R); }),
+                 Result.end());
+    return Result;
+}
@@ -0,0 +1,84 @@
+#include "GitChanges.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+
+#include <optional>
+#include <set>
+
+namespace
+{
+    // Запускает git с аргументами Args и возвращает его стандартный вывод.
+    // Сообщения git об ошибках идут в stderr процесса как есть.
+    llvm::Expected<std::string> runGit(llvm::StringRef Git, llvm::ArrayRef<llvm::StringRef> Args)
+    {
+        llvm::SmallString<128> OutPath;
+        if (auto EC = llvm::sys::fs::createTemporaryFile("refactor-git", "out", OutPath))
+            return llvm::createStringError(EC, "cannot create temporary file for git output");
+        llvm::FileRemover Remover(OutPath);
+
+        std::vector<llvm::StringRef> Argv = {Git};
+        Argv.insert(Argv.end(), Args.begin(), Args.end());
+        std::optional<llvm::StringRef> Redirects[] = {llvm::StringRef(), llvm::StringRef(OutPath), std::nullopt};
+        std::string ErrMsg;
+        int Code = llvm::sys::ExecuteAndWait(Git, Argv, /*Env=*/std::nullopt, Redirects, /*SecondsToWait=*/0,
+                                             /*MemoryLimit=*/0, &ErrMsg);
+        if (Code != 0)
+        {
+            std::string Command = "git";
+            for (auto Arg : Args)
+                Command += " " + Arg.str();
+            return llvm::createStringError(llvm::inconvertibleErrorCode(), "'%s' failed%s%s", Command.c_str(),
+                                           ErrMsg.empty() ? "" : ": ", ErrMsg.c_str());
+        }
+
+        auto Buf = llvm::MemoryBuffer::getFile(OutPath);
+        if (!Buf)
+            return llvm::createStringError(Buf.getError(), "cannot read git output");
+        return (*Buf)->getBuffer().str();
+    }
+} // namespace
+
+llvm::Expected<std::vector<std::string>> gitChangedFiles(llvm::StringRef Rev, llvm::StringRef WorkDir)
+{
+    // Ревизия не должна читаться git'ом как опция.
+    if (Rev.empty() || Rev.starts_with("-"))
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), "invalid revision '%s'", Rev.str().c_str());
+
+    auto Git = llvm::sys::findProgramByName("git");
+    if (!Git)
+        return llvm::createStringError(Git.getError(), "git not found in PATH");
+
+    auto TopLevel = runGit(*Git, {"-C", WorkDir, "rev-parse", "--show-toplevel"});
+    if (!TopLevel)
+        return TopLevel.takeError();
+    std::string Root = llvm::StringRef(*TopLevel).trim().str();
+
+    // -z: пути без экранирования; --no-renames: переименование - удаление и добавление,
+    // так в список попадают оба имени.
+    auto Diff = runGit(*Git, {"-C", Root, "diff", "--name-only", "-z", "--no-renames", Rev, "--"});
+    if (!Diff)
+        return Diff.takeError();
+    auto Untracked = runGit(*Git, {"-C", Root, "ls-files", "-z", "--others", "--exclude-standard"});
+    if (!Untracked)
+        return Untracked.takeError();
+
+    std::set<std::string> Files;
+    for (llvm::StringRef Output : {llvm::StringRef(*Diff), llvm::StringRef(*Untracked)})
+    {
+        llvm::SmallVector<llvm::StringRef> Names;
+        Output.split(Names, '\0', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+        for (auto Name : Names)
+        {
+            llvm::SmallString<256> Path(Root);
+            llvm::sys::path::append(Path, Name);
+            llvm::sys::path::native(Path);
+            Files.insert(std::string(Path));
+        }
+    }
+    return std::vector<std::string>(Files.begin(), Files.end());
+}
@@ -0,0 +1,233 @@
+#include "HierarchySummary.h"
+#include "ClassHierarchyIndex.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Index/USRGeneration.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <optional>
+
+using namespace clang;
+
+namespace
+{
+    constexpr llvm::StringLiteral Magic = "RTHS";
+    constexpr uint32_t Version = 1;
+    constexpr size_t HeaderSize = 16;
+
+    llvm::Error malformed(llvm::StringRef Path, llvm::StringRef What)
+    {
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "malformed hierarchy summary %s: %s",
+                                       Path.str().c_str(), What.str().c_str());
+    }
+
+    uint32_t read32(const char *Ptr)
+    {
+        return llvm::support::endian::read32le(Ptr);
+    }
+
+    class HierarchySummaryConsumer : public ASTConsumer
+    {
+    public:
+        explicit HierarchySummaryConsumer(std::string OutputPath) : OutputPath(std::move(OutputPath)) {}
+
+        void HandleTranslationUnit(ASTContext &Context) override
+        {
+            ClassHierarchyIndex Index;
+            Index.build(Context);
+
+            auto &SM = Context.getSourceManager();
+            std::vector<std::pair<std::string, std::string>> Edges;
+            llvm::SmallString<128> BaseUSR, DerivedUSR;
+            Index.forEachEdge([&](const CXXRecordDecl *Base, const CXXRecordDecl *Derived)
+                              {
+                                  // Классы из системных заголовков рефакторинг не трогает.
+                                  if (SM.isInSystemHeader(Base->getLocation()))
+                                      return;
+                                  BaseUSR.clear();
+                                  DerivedUSR.clear();
+                                  if (index::generateUSRForDecl(Base, BaseUSR) ||
+                                      index::generateUSRForDecl(Derived, DerivedUSR))
+                                      return;
+                                  Edges.emplace_back(std::string(BaseUSR), std::string(DerivedUSR)); });
+
+            if (auto Err = writeHierarchySummary(OutputPath, std::move(Edges)))
+                llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+        }
+
+    private:
+        std::string OutputPath;
+    };
+
+    class HierarchySummaryAction : public ASTFrontendAction
+    {
+    public:
+        explicit HierarchySummaryAction(llvm::StringRef OutputDir) : OutputDir(OutputDir) {}
+
+        std::unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &CI, llvm::StringRef File) override
+        {
+            // Имя сводки - хэш абсолютного пути главного файла: стабильно между запусками
+            // и не конфликтует для одноимённых файлов из разных каталогов.
+            llvm::SmallString<256> MainPath(File);
+            CI.getFileManager().makeAbsolutePath(MainPath);
+            llvm::sys::path::remove_dots(MainPath, /*remove_dot_dot=*/true);
+
+            llvm::SmallString<256> OutputPath(OutputDir);
+            llvm::sys::path::append(OutputPath,
+                                    llvm::sys::path::filename(MainPath) + "-" +
+                                        llvm::utohexstr(llvm::xxh3_64bits(llvm::arrayRefFromStringRef(MainPath))) +
+                                        HierarchySummaryExt);
+            return std::make_unique<HierarchySummaryConsumer>(std::string(OutputPath));
+        }
+
+    private:
+        std::string OutputDir;
+    };
+
+    class HierarchySummaryActionFactory : public tooling::FrontendActionFactory
+    {
+    public:
+        explicit HierarchySummaryActionFactory(llvm::StringRef OutputDir) : OutputDir(OutputDir) {}
+
+        std::unique_ptr<FrontendAction> create() override
+        {
+            return std::make_unique<HierarchySummaryAction>(OutputDir);
+        }
+
+    private:
+        std::string OutputDir;
+    };
+} // namespace
+
+llvm::Error writeHierarchySummary(llvm::StringRef Path,
+                                  std::vector<std::pair<std::string, std::string>> Edges)
+{
+    llvm::sort(Edges);
+    Edges.erase(std::unique(Edges.begin(), Edges.end()), Edges.end());
+
+    // Интернируем USR: каждая строка хранится в файле один раз.
+    llvm::StringMap<uint32_t> Ids;
+    std::vector<llvm::StringRef> Strings;
+    auto intern = [&](llvm::StringRef S)
+    {
+        auto [It, Inserted] = Ids.try_emplace(S, Strings.size());
+        if (Inserted)
+            Strings.push_back(It->first());
+        return It->second;
+    };
+    std::vector<uint32_t> EdgeIds;
+    EdgeIds.reserve(Edges.size() * 2);
+    for (const auto &[Base, Derived] : Edges)
+    {
+        EdgeIds.push_back(intern(Base));
+        EdgeIds.push_back(intern(Derived));
+    }
+
+    return llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                               {
+                                   llvm::support::endian::Writer W(OS, llvm::endianness::little);
+                                   OS << Magic;
+                                   W.write<uint32_t>(Version);
+                                   W.write<uint32_t>(Strings.size());
+                                   W.write<uint32_t>(Edges.size());
+                                   uint32_t Offset = 0;
+                                   for (auto S : Strings)
+                                   {
+                                       W.write<uint32_t>(Offset);
+                                       Offset += S.size();
+                                   }
+                                   W.write<uint32_t>(Offset);
+                                   for (auto Id : EdgeIds)
+                                       W.write<uint32_t>(Id);
+                                   for (auto S : Strings)
+                                       OS << S;
+                                   return llvm::Error::success(); });
+}
+
+llvm::Error GlobalHierarchy::load(llvm::StringRef Path)
+{
+    // Без требования нулевого терминатора MemoryBuffer отображает большие файлы в память.
+    auto BufOrErr = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false,
+                                                /*RequiresNullTerminator=*/false);
+    if (!BufOrErr)
+        return llvm::createStringError(BufOrErr.getError(), "cannot open hierarchy summary %s",
+                                       Path.str().c_str());
+
+    auto Data = (*BufOrErr)->getBuffer();
+    if (Data.size() < HeaderSize || !Data.starts_with(Magic))
+        return malformed(Path, "bad header");
+    if (read32(Data.data() + 4) != Version)
+        return malformed(Path, "unsupported version");
+
+    uint64_t NumStrings = read32(Data.data() + 8);
+    uint64_t NumEdges = read32(Data.data() + 12);
+    uint64_t OffsetsPos = HeaderSize;
+    uint64_t EdgesPos = OffsetsPos + (NumStrings + 1) * 4;
+    uint64_t BlobPos = EdgesPos + NumEdges * 8;
+    if (BlobPos > Data.size())
+        return malformed(Path, "truncated");
+
+    auto Blob = Data.drop_front(BlobPos);
+    auto stringAt = [&](uint32_t Id) -> std::optional<llvm::StringRef>
+    {
+        if (Id >= NumStrings)
+            return std::nullopt;
+        const char *Offsets = Data.data() + OffsetsPos + Id * 4;
+        uint32_t Begin = read32(Offsets), End = read32(Offsets + 4);
+        if (Begin > End || End > Blob.size())
+            return std::nullopt;
+        return Blob.slice(Begin, End);
+    };
+
+    for (uint64_t I = 0; I < NumEdges; ++I)
+    {
+        auto Base = stringAt(read32(Data.data() + EdgesPos + I * 8));
+        if (!Base || !stringAt(read32(Data.data() + EdgesPos + I * 8 + 4)))
+            return malformed(Path, "bad edge");
+        Bases.insert(llvm::CachedHashStringRef(*Base));
+    }
+    Edges += NumEdges;
+    uint64_t Parts[2] = {Fingerprint, llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Data))};
+    Fingerprint = llvm::xxh3_64bits(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(Parts), sizeof(Parts)));
+    Buffers.push_back(std::move(*BufOrErr));
+    return llvm::Error::success();
+}
+
+llvm::Error GlobalHierarchy::loadDirectory(llvm::StringRef Dir)
+{
+    std::error_code EC;
+    std::vector<std::string> Paths;
+    for (llvm::sys::fs::directory_iterator It(Dir, EC), End; It != End && !EC; It.increment(EC))
+        if (llvm::sys::path::extension(It->path()) == HierarchySummaryExt)
+            Paths.push_back(It->path());
+    if (EC)
+        return llvm::createStringError(EC, "cannot read hierarchy summaries from %s", Dir.str().c_str());
+
+    llvm::sort(Paths);
+    for (const auto &Path : Paths)
+        if (auto Err = load(Path))
+            return Err;
+    return llvm::Error::success();
+}
+
+bool GlobalHierarchy::hasDerived(llvm::StringRef BaseUSR) const
+{
+    return Bases.count(llvm::CachedHashStringRef(BaseUSR));
+}
+
+std::unique_ptr<tooling::FrontendActionFactory>
+newHierarchySummaryActionFactory(llvm::StringRef OutputDir)
+{
+    return std::make_unique<HierarchySummaryActionFactory>(OutputDir);
+}
@@ -0,0 +1,111 @@
+#include "InMemoryRefactor.h"
+
+#include "clang/Basic/DiagnosticOptions.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Driver/Driver.h"
+#include "clang/Frontend/TextDiagnosticPrinter.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+using namespace clang::tooling;
+
+namespace
+{
+    int StaticSymbol; // адрес внутри исполняемого файла для getMainExecutable
+
+    // Как ClangTool: встроенные заголовки clang (stddef.h и т.п.) берутся рядом с этим
+    // исполняемым файлом, а не рядом с компилятором из команды.
+    void injectResourceDir(std::vector<std::string> &CommandLine)
+    {
+        if (CommandLine.empty() || llvm::any_of(CommandLine, [](llvm::StringRef Arg)
+                                                { return Arg.starts_with("-resource-dir"); }))
+            return;
+        std::string Exe = llvm::sys::fs::getMainExecutable("refactor_tool", &StaticSymbol);
+        CommandLine.insert(CommandLine.begin() + 1, "-resource-dir=" + driver::Driver::GetResourcesPath(Exe));
+    }
+
+    // CommandLine - полная команда (argv[0], флаги, главный файл), Directory - её рабочий каталог.
+    llvm::Expected<RefactoredCode> refactorInMemory(llvm::StringRef Code, std::vector<std::string> CommandLine,
+                                                    llvm::StringRef Directory, llvm::StringRef FileName,
+                                                    const RefactorOptions &Options)
+    {
+        // Своя физическая ФС: смена рабочего каталога не затрагивает процесс и другие потоки.
+        auto Overlay = llvm::makeIntrusiveRefCnt<llvm::vfs::OverlayFileSystem>(llvm::vfs::createPhysicalFileSystem());
+        auto Memory = llvm::makeIntrusiveRefCnt<llvm::vfs::InMemoryFileSystem>();
+        Overlay->pushOverlay(Memory);
+        if (auto EC = Overlay->setCurrentWorkingDirectory(Directory))
+            return llvm::createStringError(EC, "cannot use working directory %s", Directory.str().c_str());
+
+        llvm::SmallString<256> MainPath(FileName);
+        if (auto EC = Overlay->makeAbsolute(MainPath))
+            return llvm::createStringError(EC, "cannot resolve %s", FileName.str().c_str());
+        llvm::sys::path::remove_dots(MainPath, /*remove_dot_dot=*/true);
+        Memory->addFile(MainPath, 0, llvm::MemoryBuffer::getMemBufferCopy(Code, MainPath));
+
+        // Диагностика копится в строку и попадает в ошибку, если TU не разобралась.
+        std::string DiagText;
+        llvm::raw_string_ostream DiagOS(DiagText);
+        auto DiagOpts = llvm::makeIntrusiveRefCnt<DiagnosticOptions>();
+        TextDiagnosticPrinter Printer(DiagOS, DiagOpts.get());
+
+        injectResourceDir(CommandLine);
+        TUResult TU;
+        auto Files = llvm::makeIntrusiveRefCnt<FileManager>(FileSystemOptions(), Overlay);
+        ToolInvocation Invocation(std::move(CommandLine),
+                                  std::make_unique<CodeRefactorAction>(nullptr, Options, &TU), Files.get());
+        Invocation.setDiagnosticConsumer(&Printer);
+        if (!Invocation.run())
+            return llvm::createStringError(llvm::inconvertibleErrorCode(), "cannot parse %s\n%s",
+                                           MainPath.c_str(), DiagText.c_str());
+        if (Options.Claims)
+            Options.Claims->commit(TU.ClaimedHeaders);
+        if (Options.Ranking)
+            for (auto &Candidate : TU.Ranked)
+                Options.Ranking->add(std::move(Candidate));
+
+        RefactoredCode Result;
+        Replacements Replaces;
+        for (const auto &Edit : TU.Edits)
+        {
+            if (Edit.getFilePath() != MainPath)
+                continue;
+            if (auto Err = Replaces.add(Edit))
+                return std::move(Err);
+            Result.Edits.push_back(Edit);
+        }
+        auto NewCode = applyAllReplacements(Code, Replaces);
+        if (!NewCode)
+            return NewCode.takeError();
+        Result.Code = std::move(*NewCode);
+        return Result;
+    }
+} // namespace
+
+llvm::Expected<RefactoredCode> refactorCode(llvm::StringRef Code, llvm::ArrayRef<std::string> Args,
+                                            llvm::StringRef FileName, const RefactorOptions &Options)
+{
+    llvm::SmallString<256> Directory;
+    if (auto EC = llvm::sys::fs::current_path(Directory))
+        return llvm::createStringError(EC, "cannot get current directory");
+
+    std::vector<std::string> CommandLine = {"refactor_tool", "-fsyntax-only"};
+    CommandLine.insert(CommandLine.end(), Args.begin(), Args.end());
+    CommandLine.push_back(FileName.str());
+    return refactorInMemory(Code, std::move(CommandLine), Directory, FileName, Options);
+}
+
+llvm::Expected<RefactoredCode> refactorCode(llvm::StringRef Code, const CompileCommand &Command,
+                                            const RefactorOptions &Options)
+{
+    // Как в ClangTool: только разбор, без -o и генерации кода.
+    auto Adjust = combineAdjusters(getClangStripOutputAdjuster(), getClangSyntaxOnlyAdjuster());
+    return refactorInMemory(Code, Adjust(Command.CommandLine, Command.Filename), Command.Directory,
+                            Command.Filename, Options);
+}
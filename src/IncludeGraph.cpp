@@ -0,0 +1,192 @@
+#include "IncludeGraph.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <optional>
+
+using namespace clang::tooling;
+
+namespace
+{
+    constexpr int64_t GraphVersion = 1;
+
+    llvm::Error malformed(llvm::StringRef Path, llvm::StringRef What)
+    {
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), "malformed include graph %s: %s",
+                                       Path.str().c_str(), What.str().c_str());
+    }
+
+    // Каталог и командная строка каждой команды: смена флагов меняет результат TU.
+    std::string commandHash(llvm::ArrayRef<CompileCommand> Commands)
+    {
+        std::string Text;
+        for (const auto &Command : Commands)
+        {
+            Text += Command.Directory;
+            Text += '\0';
+            for (const auto &Arg : Command.CommandLine)
+            {
+                Text += Arg;
+                Text += '\0';
+            }
+            Text += '\n';
+        }
+        return llvm::utohexstr(llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Text)), /*LowerCase=*/true);
+    }
+} // namespace
+
+std::string IncludeGraph::canonicalPath(llvm::StringRef Path)
+{
+    llvm::SmallString<256> Real;
+    if (!llvm::sys::fs::real_path(Path, Real))
+        return std::string(Real);
+
+    // Удалённый файл: канонизируем каталог, если он ещё есть.
+    llvm::SmallString<256> Abs(Path);
+    llvm::sys::fs::make_absolute(Abs);
+    llvm::sys::path::remove_dots(Abs, /*remove_dot_dot=*/true);
+    if (!llvm::sys::fs::real_path(llvm::sys::path::parent_path(Abs), Real))
+    {
+        llvm::sys::path::append(Real, llvm::sys::path::filename(Abs));
+        return std::string(Real);
+    }
+    return std::string(Abs);
+}
+
+llvm::Expected<IncludeGraph> IncludeGraph::load(llvm::StringRef Path)
+{
+    IncludeGraph Graph;
+    auto Buf = llvm::MemoryBuffer::getFile(Path);
+    if (!Buf)
+    {
+        if (Buf.getError() == std::errc::no_such_file_or_directory)
+            return Graph;
+        return llvm::createStringError(Buf.getError(), "cannot read include graph %s", Path.str().c_str());
+    }
+
+    auto Json = llvm::json::parse((*Buf)->getBuffer());
+    if (!Json)
+        return Json.takeError();
+    const auto *Root = Json->getAsObject();
+    if (!Root || Root->getInteger("version") != GraphVersion)
+        return malformed(Path, "unsupported version");
+    const auto *Files = Root->getArray("files");
+    const auto *Units = Root->getArray("tus");
+    if (!Files || !Units)
+        return malformed(Path, "missing files or tus");
+
+    std::vector<llvm::StringRef> Names;
+    for (const auto &File : *Files)
+    {
+        auto Name = File.getAsString();
+        if (!Name)
+            return malformed(Path, "bad file name");
+        Names.push_back(*Name);
+    }
+    auto nameAt = [&](const llvm::json::Value &Index) -> std::optional<llvm::StringRef>
+    {
+        auto I = Index.getAsInteger();
+        if (!I || *I < 0 || static_cast<uint64_t>(*I) >= Names.size())
+            return std::nullopt;
+        return Names[*I];
+    };
+
+    for (const auto &Unit : *Units)
+    {
+        const auto *Object = Unit.getAsObject();
+        const llvm::json::Value *File = Object ? Object->get("file") : nullptr;
+        const auto *Includes = Object ? Object->getArray("includes") : nullptr;
+        auto Command = Object ? Object->getString("command") : std::nullopt;
+        auto Name = File ? nameAt(*File) : std::nullopt;
+        if (!Name || !Includes || !Command)
+            return malformed(Path, "bad translation unit");
+
+        Entry &E = Graph.TUs[Name->str()];
+        E.Command = Command->str();
+        for (const auto &Include : *Includes)
+        {
+            auto IncludeName = nameAt(Include);
+            if (!IncludeName)
+                return malformed(Path, "bad include");
+            E.Includes.push_back(IncludeName->str());
+        }
+    }
+    return Graph;
+}
+
+llvm::Error IncludeGraph::save(llvm::StringRef Path) const
+{
+    // Заголовок, общий для тысяч TU, хранится один раз.
+    llvm::StringMap<int64_t> Ids;
+    llvm::json::Array Files;
+    auto intern = [&](llvm::StringRef Name)
+    {
+        auto [It, Inserted] = Ids.try_emplace(Name, Files.size());
+        if (Inserted)
+            Files.push_back(Name);
+        return It->second;
+    };
+
+    llvm::json::Array Units;
+    for (const auto &[TU, E] : TUs)
+    {
+        llvm::json::Array Includes;
+        for (const auto &Include : E.Includes)
+            Includes.push_back(intern(Include));
+        Units.push_back(llvm::json::Object{{"file", intern(TU)}, {"command", E.Command}, {"includes", std::move(Includes)}});
+    }
+
+    llvm::json::Object Root{{"version", GraphVersion}, {"files", std::move(Files)}, {"tus", std::move(Units)}};
+    return llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                               {
+                                   OS << llvm::json::Value(std::move(Root)) << "\n";
+                                   return llvm::Error::success(); });
+}
+
+void IncludeGraph::update(llvm::StringRef TU, llvm::ArrayRef<CompileCommand> Commands,
+                          llvm::ArrayRef<std::string> Includes)
+{
+    Entry &E = TUs[canonicalPath(TU)];
+    E.Command = commandHash(Commands);
+    E.Includes.clear();
+    for (const auto &Include : Includes)
+        E.Includes.push_back(canonicalPath(Include));
+    llvm::sort(E.Includes);
+    E.Includes.erase(std::unique(E.Includes.begin(), E.Includes.end()), E.Includes.end());
+}
+
+std::vector<std::string> IncludeGraph::affected(llvm::ArrayRef<std::string> Candidates,
+                                                llvm::ArrayRef<std::string> Changed,
+                                                const CompilationDatabase &Compilations) const
+{
+    // Один проход по рёбрам графа: TU, включающие хотя бы один изменённый файл.
+    llvm::StringSet<> ChangedFiles;
+    for (const auto &File : Changed)
+        ChangedFiles.insert(canonicalPath(File));
+    llvm::StringSet<> Dirty;
+    for (const auto &[TU, E] : TUs)
+        if (llvm::any_of(E.Includes, [&](const std::string &Include)
+                         { return ChangedFiles.contains(Include); }))
+            Dirty.insert(TU);
+
+    std::vector<std::string> Result;
+    for (const auto &Candidate : Candidates)
+    {
+        std::string TU = canonicalPath(Candidate);
+        auto It = TUs.find(TU);
+        if (It == TUs.end() || ChangedFiles.contains(TU) || Dirty.contains(TU) ||
+            It->second.Command != commandHash(Compilations.getCompileCommands(Candidate)))
+            Result.push_back(Candidate);
+    }
+    return Result;
+}
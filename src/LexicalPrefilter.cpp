@@ -0,0 +1,104 @@
+#include "LexicalPrefilter.h"
+#include "RefactorCheck.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstring>
+
+namespace
+{
+    bool isIdentifierChar(char C)
+    {
+        // Байты UTF-8 тоже считаются частью идентификатора: так слово не найдётся внутри
+        // идентификатора с не-ASCII символами, но и не пропустится - clang их не разделяет.
+        return llvm::isAlnum(C) || C == '_' || C == '$' || static_cast<unsigned char>(C) >= 0x80;
+    }
+
+    // Поиск memchr по первому байту (векторизован в libc) и сравнение остатка.
+    // Слово должно стоять отдельно: "for" не находится в "format".
+    bool containsToken(llvm::StringRef Text, llvm::StringRef Token)
+    {
+        const bool Word = isIdentifierChar(Token.front());
+        const char *Begin = Text.data();
+        const char *End = Begin + Text.size();
+        for (const char *P = Begin; P < End; ++P)
+        {
+            P = static_cast<const char *>(std::memchr(P, Token.front(), End - P));
+            if (!P || static_cast<size_t>(End - P) < Token.size())
+                return false;
+            if (std::memcmp(P, Token.data(), Token.size()) != 0)
+                continue;
+            if (!Word)
+                return true;
+            const char *After = P + Token.size();
+            if ((P == Begin || !isIdentifierChar(P[-1])) && (After == End || !isIdentifierChar(*After)))
+                return true;
+        }
+        return false;
+    }
+
+    // Склейка строк '\' + перевод строки (clang допускает пробелы между ними) может
+    // разорвать ключевое слово, и тогда поиск по сырому тексту его не найдёт.
+    bool hasLineSplice(llvm::StringRef Text)
+    {
+        const char *End = Text.data() + Text.size();
+        for (const char *P = Text.data(); P < End; ++P)
+        {
+            P = static_cast<const char *>(std::memchr(P, '\\', End - P));
+            if (!P)
+                return false;
+            const char *Next = P + 1;
+            while (Next < End && (*Next == ' ' || *Next == '\t'))
+                ++Next;
+            if (Next < End && (*Next == '\n' || *Next == '\r'))
+                return true;
+        }
+        return false;
+    }
+} // namespace
+
+LexicalPrefilter::LexicalPrefilter(const RefactorOptions &Options)
+{
+    // С --header-filter правки возможны в заголовках, которых фильтр не читает.
+    if (!Options.HeaderFilter.empty())
+    {
+        Enabled = false;
+        return;
+    }
+    for (const auto &Info : registeredChecks())
+    {
+        if (!Options.isEnabled(Info.Name))
+            continue;
+        if (Info.AnyOfTokens.empty())
+        {
+            Enabled = false;
+            return;
+        }
+        Tokens.insert(Tokens.end(), Info.AnyOfTokens.begin(), Info.AnyOfTokens.end());
+    }
+}
+
+bool LexicalPrefilter::mayProduceEdits(llvm::StringRef MainContent) const
+{
+    if (!Enabled)
+        return true;
+    // Триграф ??- - это '~' (до C++17 или с -trigraphs).
+    if (hasLineSplice(MainContent) || containsToken(MainContent, "??"))
+        return true;
+    for (auto Token : Tokens)
+        if (containsToken(MainContent, Token))
+            return true;
+    return false;
+}
+
+std::optional<bool> LexicalPrefilter::mayProduceEditsInFile(llvm::StringRef Path) const
+{
+    if (!Enabled)
+        return true;
+    // Без завершающего нуля MemoryBuffer отображает большие файлы в память, а не копирует их.
+    auto Buf = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+    if (!Buf)
+        return std::nullopt;
+    return mayProduceEdits((*Buf)->getBuffer());
+}
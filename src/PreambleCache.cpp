@@ -0,0 +1,288 @@
+#include "PreambleCache.h"
+
+#include "clang/Basic/LangOptions.h"
+#include "clang/Basic/Version.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/BLAKE3.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+
+using namespace clang;
+using namespace clang::tooling;
+
+namespace
+{
+    // Меняется при изменении способа сборки PCH.
+    constexpr llvm::StringLiteral PreambleVersion = "refactor-tool-preamble-v1";
+
+    // Собирает все файлы, прочитанные при сборке PCH, включая системные заголовки:
+    // их изменение так же делает PCH непригодным.
+    class AllDependencies : public DependencyCollector
+    {
+    public:
+        bool needSystemDependencies() override { return true; }
+    };
+
+    std::string absoluteIn(llvm::StringRef Dir, llvm::StringRef Path)
+    {
+        llvm::SmallString<256> Abs(Path);
+        if (llvm::sys::path::is_relative(Abs))
+            Abs = (Dir + llvm::sys::path::get_separator() + Path).str();
+        llvm::sys::path::remove_dots(Abs, /*remove_dot_dot=*/true);
+        return std::string(Abs);
+    }
+
+    // Аргументы команды без входного файла, выходов и режима компиляции:
+    // то, что одинаково для TU с одной преамбулой и определяет совместимость PCH.
+    std::vector<std::string> preambleArgs(const CompileCommand &Command, llvm::StringRef MainPath)
+    {
+        auto Args = getClangStripOutputAdjuster()(Command.CommandLine, Command.Filename);
+        Args = getClangStripDependencyFileAdjuster()(Args, Command.Filename);
+
+        std::vector<std::string> Result;
+        for (const auto &Arg : Args)
+        {
+            if (Arg == "-c" || Arg == "-S" || Arg == "-E" || Arg == "-fsyntax-only" || Arg == "--")
+                continue;
+            if (Arg == Command.Filename || absoluteIn(Command.Directory, Arg) == MainPath)
+                continue;
+            Result.push_back(Arg);
+        }
+        return Result;
+    }
+
+    int64_t mtimeOf(llvm::StringRef Path)
+    {
+        llvm::sys::fs::file_status Status;
+        if (llvm::sys::fs::status(Path, Status))
+            return -1;
+        return Status.getLastModificationTime().time_since_epoch().count();
+    }
+} // namespace
+
+PreambleCache::PreambleCache(std::string Dir) : Dir(std::move(Dir))
+{
+    llvm::sys::fs::create_directories(this->Dir);
+}
+
+std::string PreambleCache::pathFor(llvm::StringRef Key, llvm::StringRef Ext) const
+{
+    llvm::SmallString<256> Path(Dir);
+    llvm::sys::path::append(Path, Key + Ext);
+    return std::string(Path);
+}
+
+std::optional<PreambleCache::Preamble> PreambleCache::get(const CompileCommand &Command,
+                                                          llvm::StringRef MainPath,
+                                                          llvm::StringRef MainContent)
+{
+    // Для преамбулы достаточно сырого лексера, конкретный стандарт языка не важен.
+    LangOptions LangOpts;
+    LangOpts.CPlusPlus = true;
+    auto Bounds = Lexer::ComputePreamble(MainContent, LangOpts);
+    if (!Bounds.Size)
+        return std::nullopt;
+    std::string PreambleText = MainContent.take_front(Bounds.Size).str();
+    if (!Bounds.PreambleEndsAtStartOfLine)
+        PreambleText += '\n';
+
+    llvm::StringRef MainDir = llvm::sys::path::parent_path(MainPath);
+    auto Args = preambleArgs(Command, MainPath);
+
+    llvm::BLAKE3 Hasher;
+    auto add = [&](llvm::StringRef S)
+    {
+        Hasher.update(S);
+        Hasher.update(llvm::StringRef("\0", 1));
+    };
+    add(PreambleVersion);
+    add(getClangFullVersion());
+    add(Command.Directory);
+    add(MainDir);
+    for (const auto &Arg : Args)
+        add(Arg);
+    add(PreambleText);
+    std::string Key = llvm::toHex(Hasher.final<16>(), /*LowerCase=*/true);
+
+    std::shared_ptr<Entry> E;
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        auto &Slot = Entries[Key];
+        if (!Slot)
+            Slot = std::make_shared<Entry>();
+        E = Slot;
+    }
+
+    // Одну преамбулу собирает один поток, остальные ждут готового PCH.
+    std::lock_guard<std::mutex> Lock(E->Mutex);
+    if (E->Done)
+        return E->Value;
+    E->Done = true;
+    E->Value = load(Key);
+    if (E->Value)
+        return E->Value;
+
+    auto Built = build(Command, Key, Args, MainDir, PreambleText);
+    if (!Built)
+        return std::nullopt;
+    E->Value = *Built;
+    Built->JustBuilt = true;
+    return Built;
+}
+
+std::optional<PreambleCache::Preamble> PreambleCache::load(const std::string &Key) const
+{
+    std::string PchPath = pathFor(Key, ".pch");
+    int64_t PchTime = mtimeOf(PchPath);
+    if (PchTime < 0)
+        return std::nullopt;
+    auto Buf = llvm::MemoryBuffer::getFile(pathFor(Key, ".json"));
+    if (!Buf)
+        return std::nullopt;
+    auto Parsed = llvm::json::parse((*Buf)->getBuffer());
+    if (!Parsed)
+    {
+        llvm::consumeError(Parsed.takeError());
+        return std::nullopt;
+    }
+    const auto *Root = Parsed->getAsObject();
+    const auto *Deps = Root ? Root->getArray("deps") : nullptr;
+    const auto *Extra = Root ? Root->getArray("args") : nullptr;
+    if (!Deps || !Extra)
+        return std::nullopt;
+
+    Preamble P;
+    P.Key = Key;
+    P.PchPath = PchPath;
+    P.BuildSeconds = Root->getNumber("build_seconds").value_or(0);
+    for (const auto &Value : *Extra)
+    {
+        auto Arg = Value.getAsString();
+        if (!Arg)
+            return std::nullopt;
+        P.ExtraArgs.push_back(Arg->str());
+    }
+    for (const auto &Value : *Deps)
+    {
+        auto Path = Value.getAsString();
+        // Заголовок изменён после сборки PCH - clang всё равно отверг бы такой PCH.
+        if (!Path || mtimeOf(*Path) < 0 || mtimeOf(*Path) > PchTime)
+            return std::nullopt;
+        P.Dependencies.push_back(Path->str());
+    }
+    return P;
+}
+
+std::optional<PreambleCache::Preamble> PreambleCache::build(const CompileCommand &Command, const std::string &Key,
+                                                            const std::vector<std::string> &Args,
+                                                            llvm::StringRef MainDir, llvm::StringRef PreambleText)
+{
+    auto Start = std::chrono::steady_clock::now();
+    std::string HeaderPath = pathFor(Key, ".h");
+    std::string PchPath = pathFor(Key, ".pch");
+    if (auto Err = llvm::writeToOutput(HeaderPath, [&](llvm::raw_ostream &OS)
+                                       {
+                                           OS << PreambleText;
+                                           return llvm::Error::success(); }))
+    {
+        llvm::consumeError(std::move(Err));
+        return std::nullopt;
+    }
+
+    // Преамбула собирается как заголовок из каталога кэша: -iquote возвращает
+    // поиск #include "..." в каталог главного файла.
+    std::vector<std::string> BuildArgs = Args;
+    BuildArgs.insert(BuildArgs.end(), {"-iquote", MainDir.str(), "-x", "c++-header", HeaderPath, "-o", PchPath});
+    std::vector<const char *> Argv;
+    for (const auto &Arg : BuildArgs)
+        Argv.push_back(Arg.c_str());
+
+    llvm::IntrusiveRefCntPtr<llvm::vfs::FileSystem> FS = llvm::vfs::createPhysicalFileSystem();
+    FS->setCurrentWorkingDirectory(Command.Directory);
+    CreateInvocationOptions InvocationOpts;
+    InvocationOpts.VFS = FS;
+    std::shared_ptr<CompilerInvocation> Invocation = createInvocation(Argv, InvocationOpts);
+    if (!Invocation)
+        return std::nullopt;
+    Invocation->getFileSystemOpts().WorkingDir = Command.Directory;
+
+    CompilerInstance CI;
+    CI.setInvocation(std::move(Invocation));
+    CI.createDiagnostics(*FS);
+    CI.createFileManager(FS);
+    auto Deps = std::make_shared<AllDependencies>();
+    CI.addDependencyCollector(Deps);
+
+    GeneratePCHAction Action;
+    if (!CI.ExecuteAction(Action) || CI.getDiagnostics().hasErrorOccurred())
+    {
+        llvm::sys::fs::remove(PchPath);
+        return std::nullopt;
+    }
+
+    Preamble P;
+    P.Key = Key;
+    P.PchPath = PchPath;
+    P.ExtraArgs = {"-include-pch", PchPath, "-iquote", MainDir.str()};
+    for (const auto &Dep : Deps->getDependencies())
+    {
+        std::string Path = absoluteIn(Command.Directory, Dep);
+        if (Path != HeaderPath)
+            P.Dependencies.push_back(std::move(Path));
+    }
+    P.BuildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+    llvm::json::Array DepsJson(P.Dependencies);
+    llvm::json::Array ArgsJson(P.ExtraArgs);
+    llvm::json::Value Meta = llvm::json::Object{{"build_seconds", P.BuildSeconds},
+                                                {"args", std::move(ArgsJson)},
+                                                {"deps", std::move(DepsJson)}};
+    if (auto Err = llvm::writeToOutput(pathFor(Key, ".json"), [&](llvm::raw_ostream &OS)
+                                       {
+                                           OS << Meta;
+                                           return llvm::Error::success(); }))
+        llvm::consumeError(std::move(Err)); // PCH пригоден в этом запуске, но не будет найден в следующем
+
+    ++Built;
+    BuildMicros += static_cast<uint64_t>(P.BuildSeconds * 1e6);
+    return P;
+}
+
+void PreambleCache::invalidate(const Preamble &P)
+{
+    std::shared_ptr<Entry> E;
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        auto It = Entries.find(P.Key);
+        if (It == Entries.end())
+            return;
+        E = It->second;
+    }
+    std::lock_guard<std::mutex> Lock(E->Mutex);
+    if (!E->Value)
+        return;
+    E->Value.reset();
+    for (auto Ext : {".pch", ".json", ".h"})
+        llvm::sys::fs::remove(pathFor(P.Key, Ext));
+    ++Failed;
+}
+
+void PreambleCache::noteUsed(const Preamble &P)
+{
+    // Собравшая PCH TU разобрала преамбулу сама, экономят только последующие.
+    if (P.JustBuilt)
+        return;
+    ++Reused;
+    SavedMicros += static_cast<uint64_t>(P.BuildSeconds * 1e6);
+}
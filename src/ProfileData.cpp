@@ -0,0 +1,155 @@
+#include "ProfileData.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace
+{
+    llvm::Error malformed(llvm::StringRef Path, size_t Line, llvm::StringRef What)
+    {
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), "malformed profile %s:%zu: %s",
+                                       Path.str().c_str(), Line, What.str().c_str());
+    }
+} // namespace
+
+void FunctionProfile::add(llvm::StringRef Name, uint64_t Count)
+{
+    // "file.cpp;_ZL3foov" - локальная функция в инструментальном профиле.
+    if (auto Pos = Name.rfind(';'); Pos != llvm::StringRef::npos)
+        Name = Name.drop_front(Pos + 1);
+    // Клоны и переименования LTO: _Z3foov.llvm.123, _Z3foov.cold.
+    Name = Name.split('.').first;
+    if (!Name.empty())
+        Counts[Name] += Count;
+}
+
+llvm::Expected<FunctionProfile> FunctionProfile::load(llvm::StringRef Path)
+{
+    auto Buf = llvm::MemoryBuffer::getFile(Path);
+    if (!Buf)
+        return llvm::createStringError(Buf.getError(), "cannot read profile %s", Path.str().c_str());
+    llvm::StringRef Data = (*Buf)->getBuffer();
+
+    FunctionProfile Profile;
+    Profile.Fingerprint = llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Data));
+
+    llvm::SmallVector<llvm::StringRef> Lines;
+    Data.split(Lines, '\n');
+    const bool Instrumented = Data.contains("# Func Hash:");
+
+    if (Instrumented)
+    {
+        // Запись: имя, хэш, число счётчиков, счётчики; записи разделены пустой строкой.
+        // Комментарии '#' и заголовки ':ir', ':fe' пропускаются, данные value profiling не нужны.
+        llvm::StringRef Name;
+        llvm::SmallVector<uint64_t, 8> Numbers;
+        auto flush = [&]
+        {
+            if (!Name.empty() && Numbers.size() >= 2)
+            {
+                uint64_t NumCounters = Numbers[1];
+                uint64_t Max = 0;
+                for (size_t I = 2; I < Numbers.size() && I - 2 < NumCounters; ++I)
+                    Max = std::max(Max, Numbers[I]);
+                Profile.add(Name, Max);
+            }
+            Name = {};
+            Numbers.clear();
+        };
+        for (size_t I = 0; I < Lines.size(); ++I)
+        {
+            llvm::StringRef Line = Lines[I].trim();
+            if (Line.empty())
+            {
+                flush();
+                continue;
+            }
+            if (Line.starts_with("#") || (Name.empty() && Line.starts_with(":")))
+                continue;
+            if (Name.empty())
+            {
+                Name = Line;
+                continue;
+            }
+            uint64_t Value = 0;
+            if (Line.getAsInteger(0, Value))
+            {
+                if (Numbers.size() < 2)
+                    return malformed(Path, I + 1, "expected a number");
+                continue; // value profiling и прочие дополнительные данные
+            }
+            Numbers.push_back(Value);
+        }
+        flush();
+        return Profile;
+    }
+
+    // Сэмплирующий профиль: "имя:всего:вход" с начала строки, тело функции - с отступом.
+    for (size_t I = 0; I < Lines.size(); ++I)
+    {
+        llvm::StringRef Line = Lines[I].rtrim();
+        if (Line.empty() || Line.starts_with("#") || Line.starts_with(" ") || Line.starts_with("\t"))
+            continue;
+        auto [NameAndTotal, Head] = Line.rsplit(':');
+        auto [Name, Total] = NameAndTotal.rsplit(':');
+        uint64_t Samples = 0, HeadSamples = 0;
+        if (Name.empty() || Total.getAsInteger(10, Samples) || Head.getAsInteger(10, HeadSamples))
+            return malformed(Path, I + 1, "expected 'name:total:head'");
+        Profile.add(Name, Samples);
+    }
+    return Profile;
+}
+
+double RankedEdit::score() const
+{
+    return static_cast<double>(Count) * static_cast<double>(ElementSize) *
+           static_cast<double>(std::max<uint64_t>(Iterations, 1));
+}
+
+void EditRanking::add(RankedEdit Edit)
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Edits.push_back(std::move(Edit));
+}
+
+llvm::Error EditRanking::write(llvm::StringRef Path) const
+{
+    std::vector<RankedEdit> Sorted;
+    {
+        std::lock_guard<std::mutex> Lock(Mutex);
+        Sorted = Edits;
+    }
+    // Сначала сделанные правки: повтор того же места из другой TU их не вытесняет.
+    llvm::sort(Sorted, [](const RankedEdit &L, const RankedEdit &R)
+               { return std::tie(L.File, L.Line, L.Column, R.Applied, R.Count) <
+                        std::tie(R.File, R.Line, R.Column, L.Applied, L.Count); });
+    Sorted.erase(std::unique(Sorted.begin(), Sorted.end(), [](const RankedEdit &L, const RankedEdit &R)
+                             { return std::tie(L.File, L.Line, L.Column) == std::tie(R.File, R.Line, R.Column); }),
+                 Sorted.end());
+    std::stable_sort(Sorted.begin(), Sorted.end(), [](const RankedEdit &L, const RankedEdit &R)
+                     { return L.score() > R.score(); });
+
+    return llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                               {
+                                   OS << "# score\tcount\tsize\titerations\tlocation\tfunction\tstatus\n";
+                                   for (const auto &E : Sorted)
+                                   {
+                                       OS << llvm::format("%.0f", E.score()) << '\t' << E.Count << '\t'
+                                          << E.ElementSize << '\t';
+                                       if (E.Iterations)
+                                           OS << E.Iterations;
+                                       else
+                                           OS << '?';
+                                       OS << '\t' << E.File << ':' << E.Line << ':' << E.Column << '\t'
+                                          << E.Function << '\t' << (E.Applied ? "applied" : "skipped") << '\n';
+                                   }
+                                   return llvm::Error::success(); });
+}
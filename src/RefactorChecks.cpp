@@ -0,0 +1,1201 @@
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Mangle.h"
+#include "clang/AST/ParentMapContext.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Analysis/Analyses/ExprMutationAnalyzer.h"
+#include "clang/ASTMatchers/ASTMatchers.h"
+#include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Index/USRGeneration.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <optional>
+
+#include "RefactorCheck.h"
+#include "RefactorTool.h"
+#include "ClassHierarchyIndex.h"
+#include "HierarchySummary.h"
+#include "ProfileData.h"
+
+using namespace clang;
+using namespace clang::ast_matchers;
+
+namespace details
+{
+    // Место для ' override': сразу после последнего токена декларатора метода - cv/ref-квалификаторов,
+    // noexcept(...), throw(...), атрибутов, макросов и завершающего возвращаемого типа.
+    // Сырой лексер читает токены от ')' списка параметров до '{', ';', '=', ':' или 'try',
+    // поэтому тело метода не читается, а комментарии пропускаются и остаются после вставки.
+    std::optional<SourceLocation> GetOverrideInsertLoc(const FunctionDecl *Func, const SourceManager &SM,
+                                                       const LangOptions &LangOpts)
+    {
+        auto FTL = Func->getFunctionTypeLoc();
+        if (!FTL)
+            return std::nullopt;
+        SourceLocation RParen = FTL.getRParenLoc();
+        if (RParen.isInvalid() || !RParen.isFileID())
+            return std::nullopt; // объявление из макроса не правим
+
+        auto [FID, Offset] = SM.getDecomposedLoc(RParen);
+        bool Invalid = false;
+        llvm::StringRef Buffer = SM.getBufferData(FID, &Invalid);
+        if (Invalid)
+            return std::nullopt;
+        Lexer Lex(SM.getLocForStartOfFile(FID), LangOpts, Buffer.begin(), Buffer.data() + Offset, Buffer.end());
+
+        Token Tok;
+        auto next = [&]
+        {
+            Lex.LexFromRawLexer(Tok);
+            return Tok.isNot(tok::eof);
+        };
+        // Tok - открывающая скобка; после вызова Tok - парная ей закрывающая.
+        auto skipBalanced = [&]
+        {
+            unsigned Depth = 0;
+            do
+            {
+                if (Tok.isOneOf(tok::l_paren, tok::l_square, tok::l_brace))
+                    ++Depth;
+                else if (Tok.isOneOf(tok::r_paren, tok::r_square, tok::r_brace) && --Depth == 0)
+                    return true;
+            } while (next());
+            return false;
+        };
+
+        if (!next() || Tok.isNot(tok::r_paren))
+            return std::nullopt;
+        SourceLocation InsertLoc = Tok.getEndLoc();
+
+        bool TrailingReturn = false;
+        while (next())
+        {
+            if (Tok.isOneOf(tok::l_brace, tok::semi, tok::equal, tok::colon))
+                return InsertLoc;
+
+            if (Tok.is(tok::raw_identifier))
+            {
+                llvm::StringRef Word = Tok.getRawIdentifier();
+                if (Word == "try" || Word == "override" || Word == "final")
+                    return InsertLoc;
+                // const, volatile, noexcept, throw, __attribute__, макросы, части возвращаемого типа
+            }
+            else if (Tok.isOneOf(tok::l_paren, tok::l_square))
+            {
+                // Аргументы noexcept/throw/атрибута/макроса или [[...]]
+                if (!skipBalanced())
+                    return std::nullopt;
+            }
+            else if (Tok.is(tok::arrow))
+                TrailingReturn = true;
+            else if (!TrailingReturn && !Tok.isOneOf(tok::amp, tok::ampamp))
+                return std::nullopt; // незнакомая конструкция - не рискуем
+            InsertLoc = Tok.getEndLoc();
+        }
+        return std::nullopt;
+    }
+} // end namespace details
+
+DeclarationMatcher NvDtorMatcher()
+{
+    return cxxDestructorDecl(unless(isVirtual()), unless(isImplicit())).bind("nonVirtualDtor");
+}
+
+DeclarationMatcher NoOverrideMatcher()
+{
+    return cxxMethodDecl(
+               isOverride(),
+               unless(cxxDestructorDecl()) // исключаем деструкторы
+               )
+        .bind("missingOverride");
+}
+
+DeclarationMatcher NoOverrideInInstantiationMatcher()
+{
+    return cxxMethodDecl(isOverride(), unless(cxxDestructorDecl()), ofClass(cxxRecordDecl(isTemplateInstantiation())))
+        .bind("missingOverride");
+}
+
+StatementMatcher VectorPushBackLoopMatcher()
+{
+    auto PushBack = cxxMemberCallExpr(
+        callee(cxxMethodDecl(hasAnyName("push_back", "emplace_back"), ofClass(hasName("::std::vector")))),
+        on(declRefExpr(to(varDecl(hasLocalStorage(), unless(parmVarDecl())).bind("vector")))));
+    // Вставка безусловная: вызов - само тело цикла или оператор верхнего уровня в нём.
+    auto Unconditional = expr(ignoringImplicit(PushBack));
+    auto Body = hasBody(anyOf(Unconditional, compoundStmt(has(Unconditional))));
+    auto Counter = declRefExpr(to(varDecl(equalsBoundNode("counter"))));
+    return stmt(anyOf(forStmt(hasLoopInit(declStmt(hasSingleDecl(
+                                  varDecl(hasInitializer(ignoringImplicit(integerLiteral(equals(0)))))
+                                      .bind("counter")))),
+                              hasCondition(binaryOperator(hasOperatorName("<"), hasLHS(ignoringImplicit(Counter)),
+                                                          hasRHS(expr().bind("tripCount")))),
+                              hasIncrement(unaryOperator(hasOperatorName("++"), hasUnaryOperand(Counter))), Body),
+                      cxxForRangeStmt(hasRangeInit(expr().bind("range")), Body)))
+        .bind("loop");
+}
+
+DeclarationMatcher ValueParamFunctionMatcher()
+{
+    return functionDecl(isDefinition(), unless(isImplicit()), unless(isDeleted()), unless(isDefaulted()),
+                        unless(cxxMethodDecl(isVirtual())),
+                        hasAnyParameter(parmVarDecl(hasType(hasCanonicalType(recordType())))))
+        .bind("function");
+}
+
+StatementMatcher NoRefVarInRangeLoopMatcher()
+{
+    return cxxForRangeStmt(
+               hasLoopVariable(
+                   varDecl(
+                       hasType(qualType(
+                           unless(referenceType()))))
+                       .bind("loopVar")))
+        .bind("rangeFor");
+}
+
+void RefactorCheck::run(const MatchFinder::MatchResult &Result)
+{
+    Handler.timed(getID(), [&]
+                  { check(Result); });
+}
+
+TraversalKind RefactorCheck::traversalKind() const
+{
+    return Handler.options().SkipInstantiations ? TK_IgnoreUnlessSpelledInSource : TK_AsIs;
+}
+
+namespace
+{
+    // Переменная из инстанцирования шаблона функции или члена шаблона класса.
+    bool isInInstantiation(const VarDecl *Var)
+    {
+        const auto *Func = dyn_cast_or_null<FunctionDecl>(Var->getParentFunctionOrMethod());
+        return Func && (Func->isTemplateInstantiation() || Func->getTemplateInstantiationPattern());
+    }
+
+    // Дорога ли копия значения типа T: нетривиальное копирование или больше Threshold байт.
+    // nullopt - тип неполный или зависит от параметров шаблона.
+    std::optional<bool> isExpensiveCopy(QualType T, ASTContext &Ctx, uint64_t Threshold)
+    {
+        T = T.getNonReferenceType().getUnqualifiedType();
+        if (T->isDependentType() || T->isIncompleteType())
+            return std::nullopt;
+        if (!T.isTriviallyCopyableType(Ctx))
+            return true; // конструктор копирования - вызов, возможно с выделением памяти
+        return static_cast<uint64_t>(Ctx.getTypeSizeInChars(T).getQuantity()) > Threshold;
+    }
+
+    // 1. Невиртуальные деструкторы: добавляем 'virtual ' перед '~', если есть наследники.
+    class NvDtorCheck : public RefactorCheck
+    {
+    public:
+        using RefactorCheck::RefactorCheck;
+
+        llvm::StringRef getID() const override { return "nv-dtor"; }
+
+        void registerMatchers(MatchFinder &Finder) override
+        {
+            Finder.addMatcher(traverse(traversalKind(), NvDtorMatcher()), this);
+        }
+
+        // Индекс база -> наследники нужен только этой проверке и строится одним обходом до матчеров.
+        void prepare(ASTContext &Context) override { Index.build(Context); }
+
+        void check(const MatchFinder::MatchResult &Result) override
+        {
+            if (const auto *Dtor = Result.Nodes.getNodeAs<CXXDestructorDecl>("nonVirtualDtor"))
+                handle(Dtor, Result.Context->getDiagnostics(), *Result.SourceManager);
+        }
+
+    private:
+        void handle(const CXXDestructorDecl *Dtor, DiagnosticsEngine &Diag, SourceManager &SM)
+        {
+            if (!Dtor)
+                return;
+
+            if (Dtor->isVirtual())
+                return;
+
+            // virtual пишется только в объявлении внутри класса, не в определении вида Base::~Base()
+            if (Dtor->isOutOfLine())
+                return;
+
+            const auto *Parent = Dtor->getParent();
+            if (!Parent)
+                return;
+            if (!Parent->hasDefinition())
+                return;
+
+            if (!hasDerived(Parent))
+                return;
+
+            // Место проверяется после смысловых условий: в статистике пропущенных правок
+            // остаются только те, что действительно были бы сделаны.
+            auto loc = Dtor->getLocation();
+            if (!Handler.canRewrite(SM, loc, /*ContextFree=*/false))
+                return;
+
+            if (!Handler.insertText(SM, loc, "virtual "))
+                return; // уже обработано
+
+            unsigned DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Добавлен 'virtual' к деструктору");
+            Diag.Report(loc, DiagID);
+        }
+
+        // Есть ли производные классы в TU - индекс построен заранее одним обходом.
+        // Если нет, смотрим в глобальную иерархию, собранную по всем TU.
+        bool hasDerived(const CXXRecordDecl *Record) const
+        {
+            if (Index.hasDerived(Record) || hasDerivedInProgram(Record))
+                return true;
+            if (!Handler.options().SkipInstantiations)
+                return false;
+
+            // Без инстанцирований деструктор виден только в шаблоне класса, а наследуют
+            // его инстанцирования (class D : public B<int>). Явные специализации - свои классы.
+            const auto *Template = Record->getDescribedClassTemplate();
+            if (!Template)
+                return false;
+            for (const auto *Spec : Template->specializations())
+                if (clang::isTemplateInstantiation(Spec->getSpecializationKind()) &&
+                    (Index.hasDerived(Spec) || hasDerivedInProgram(Spec)))
+                    return true;
+            return false;
+        }
+
+        // Есть ли у класса наследники в других TU (по глобальной иерархии).
+        bool hasDerivedInProgram(const CXXRecordDecl *Record) const
+        {
+            if (!Handler.options().Hierarchy)
+                return false;
+
+            llvm::SmallString<128> USR;
+            if (index::generateUSRForDecl(Record, USR))
+                return false;
+            return Handler.options().Hierarchy->hasDerived(USR);
+        }
+
+        ClassHierarchyIndex Index; // Индекс база -> наследники текущей TU
+    };
+
+    // 2. Методы без override: вставляем ' override' после декларатора.
+    class OverrideCheck : public RefactorCheck
+    {
+    public:
+        using RefactorCheck::RefactorCheck;
+
+        llvm::StringRef getID() const override { return "override"; }
+
+        void registerMatchers(MatchFinder &Finder) override
+        {
+            Finder.addMatcher(traverse(traversalKind(), NoOverrideMatcher()), this);
+            if (traversalKind() == TK_IgnoreUnlessSpelledInSource)
+                Finder.addMatcher(NoOverrideInInstantiationMatcher(), this);
+        }
+
+        void check(const MatchFinder::MatchResult &Result) override
+        {
+            if (const auto *Method = Result.Nodes.getNodeAs<CXXMethodDecl>("missingOverride"))
+                handle(Method, Result.Context->getDiagnostics(), *Result.SourceManager);
+        }
+
+    private:
+        void handle(const CXXMethodDecl *Method, DiagnosticsEngine &Diag, SourceManager &SM)
+        {
+            if (!Method)
+                return;
+
+            // Метод должен переопределять базовый
+            if (Method->size_overridden_methods() == 0 || Method->hasAttr<OverrideAttr>() || Method->hasAttr<FinalAttr>())
+                return;
+
+            // override допустим только в объявлении внутри класса, не в определении вида Derived::foo()
+            if (Method->isOutOfLine())
+                return;
+
+            // Без инстанцирований метод инстанцирования нужен, только если его шаблон
+            // не видит переопределяемый метод (база зависит от параметра шаблона).
+            if (Handler.options().SkipInstantiations)
+                if (const auto *Pattern = dyn_cast_or_null<CXXMethodDecl>(Method->getInstantiatedFromMemberFunction()))
+                    if (Pattern->size_overridden_methods() != 0)
+                        return;
+
+            auto loc = Method->getLocation();
+            if (!Handler.canRewrite(SM, loc, /*ContextFree=*/true))
+                return;
+
+            auto insertLoc = details::GetOverrideInsertLoc(Method, SM, Method->getASTContext().getLangOpts());
+            if (!insertLoc || insertLoc->isInvalid())
+            {
+                Handler.skip("unsupported_declarator");
+                return;
+            }
+            if (SM.getFileID(*insertLoc) != SM.getFileID(loc))
+            {
+                Handler.skip("other_file");
+                return;
+            }
+
+            if (!Handler.insertText(SM, *insertLoc, " override"))
+                return; // уже изменяли тут
+
+            auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Добавлен 'override' к методу");
+            Diag.Report(*insertLoc, DiagID);
+        }
+    };
+
+    // 3. range-for с дорогой копией: const T -> const T&, а неизменяемая в теле цикла T -> const T&.
+    // Дорогая копия - нетривиальное копирование или больше RefactorOptions::CopyThreshold байт.
+    class RangeForCopyCheck : public RefactorCheck
+    {
+    public:
+        using RefactorCheck::RefactorCheck;
+
+        llvm::StringRef getID() const override { return "range-for-copy"; }
+
+        void registerMatchers(MatchFinder &Finder) override
+        {
+            Finder.addMatcher(traverse(traversalKind(), NoRefVarInRangeLoopMatcher()), this);
+        }
+
+        // Искажённые имена функций нужны только для сопоставления с профилем.
+        void prepare(ASTContext &Context) override
+        {
+            if (Handler.options().ProfileData || Handler.options().Ranking)
+                Names.emplace(Context);
+        }
+
+        void check(const MatchFinder::MatchResult &Result) override
+        {
+            if (const auto *LoopVar = Result.Nodes.getNodeAs<VarDecl>("loopVar"))
+                handle(LoopVar, Result.Nodes.getNodeAs<CXXForRangeStmt>("rangeFor"),
+                       Result.Context->getDiagnostics(), *Result.SourceManager);
+        }
+
+    private:
+        void handle(const VarDecl *LoopVar, const CXXForRangeStmt *Loop, DiagnosticsEngine &Diag, SourceManager &SM)
+        {
+            if (!LoopVar)
+                return;
+
+            auto &Ctx = LoopVar->getASTContext();
+            const auto &LangOpts = Ctx.getLangOpts();
+
+            auto QT = LoopVar->getType();
+            if (QT.isNull())
+                return;
+            if (QT->isReferenceType())
+                return; // уже ссылка
+            if (QT->isPointerType())
+                return; // не трогаем указатели
+            if (QT->isFundamentalType())
+                return; // не трогаем примитивы
+
+            // Изменяемую копию заменяем ссылкой, только если тело цикла её не меняет. Тип и
+            // изменения в шаблоне зависят от аргументов, поэтому решение принимается только
+            // по нему самому, без инстанцирований.
+            const bool Const = QT.isConstQualified();
+            if (!Const)
+            {
+                if (QT.isVolatileQualified() || isa<DecompositionDecl>(LoopVar))
+                    return; // привязки структурной декомпозиции анализатор изменений не видит
+                if (const auto *Auto = QT->getContainedAutoType(); Auto && Auto->isDecltypeAuto())
+                    return; // decltype(auto) не сочетается с const
+                if (isInInstantiation(LoopVar))
+                    return;
+                if (QT->isDependentType())
+                {
+                    Handler.skip("dependent_type");
+                    return;
+                }
+            }
+
+            // Шаблонный const T дорог хотя бы для части аргументов - правка как прежде.
+            if (!isExpensiveCopy(QT, Ctx, Handler.options().CopyThreshold).value_or(true))
+            {
+                Handler.skip("cheap_copy");
+                return;
+            }
+
+            auto loc = LoopVar->getLocation();
+            if (!Handler.canRewrite(SM, loc, /*ContextFree=*/true))
+                return;
+
+            // Анализ изменений - обход тела цикла, поэтому только для мест, которые можно править.
+            if (!Const && (!Loop || !Loop->getBody() || ExprMutationAnalyzer(*Loop->getBody(), Ctx).isMutated(LoopVar)))
+            {
+                Handler.skip("mutated_copy");
+                return;
+            }
+
+            if (!LoopVar->getTypeSourceInfo())
+                return;
+            auto TL = LoopVar->getTypeSourceInfo()->getTypeLoc();
+            auto endLoc = TL.getEndLoc();
+            if (endLoc.isInvalid())
+            {
+                Handler.skip("invalid_location");
+                return;
+            }
+
+            auto insertLoc = Lexer::getLocForEndOfToken(endLoc, 0, SM, LangOpts);
+            if (insertLoc.isInvalid())
+            {
+                Handler.skip("invalid_location");
+                return;
+            }
+            if (SM.getFileID(insertLoc) != SM.getFileID(loc))
+            {
+                Handler.skip("other_file");
+                return;
+            }
+
+            // Для изменяемой копии 'const ' вставляется перед типом; обе вставки проверяются
+            // заранее, чтобы не оставить половину правки.
+            SourceLocation constLoc;
+            if (!Const)
+            {
+                constLoc = TL.getBeginLoc();
+                if (constLoc.isInvalid() || !constLoc.isFileID() || !insertLoc.isFileID())
+                {
+                    Handler.skip("macro");
+                    return;
+                }
+                if (SM.getFileID(constLoc) != SM.getFileID(loc))
+                {
+                    Handler.skip("other_file");
+                    return;
+                }
+            }
+
+            // С профилем правки ниже порога не делаются, но попадают в список кандидатов.
+            auto Candidate = rank(LoopVar, Loop, SM);
+            const auto &Options = Handler.options();
+            bool Applied = false;
+            if (Candidate && Options.ProfileData && Candidate->score() < Options.ProfileThreshold)
+                Handler.skip("below_profile_threshold");
+            else
+                Applied = (Const || Handler.insertText(SM, constLoc, "const ")) && Handler.insertText(SM, insertLoc, "&");
+            if (Candidate && Options.Ranking)
+            {
+                Candidate->Applied = Applied;
+                Handler.rank(std::move(*Candidate));
+            }
+            if (!Applied)
+                return;
+
+            auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, Const ? "Добавлен '&' в range-for переменной"
+                                                                                : "Добавлены 'const' и '&' в range-for переменной");
+            Diag.Report(insertLoc, DiagID);
+        }
+
+        // Оценка кандидата по профилю; без профиля и списка кандидатов не вычисляется.
+        std::optional<RankedEdit> rank(const VarDecl *LoopVar, const CXXForRangeStmt *Loop, SourceManager &SM)
+        {
+            if (!Names)
+                return std::nullopt;
+
+            RankedEdit Edit;
+            auto &Ctx = LoopVar->getASTContext();
+            auto Element = LoopVar->getType().getNonReferenceType();
+            if (!Element->isDependentType() && !Element->isIncompleteType())
+                Edit.ElementSize = Ctx.getTypeSizeInChars(Element).getQuantity();
+            if (Loop && Loop->getRangeInit())
+                Edit.Iterations = knownIterations(Ctx, Loop->getRangeInit()->getType());
+
+            // Шаблон без инстанцирования в профиль не попадает; его инстанцирования
+            // сопоставляются отдельно и дают то же место правки.
+            const auto *Func = dyn_cast_or_null<FunctionDecl>(LoopVar->getParentFunctionOrMethod());
+            if (Func && !Func->isDependentContext())
+            {
+                Edit.Function = Names->getName(Func);
+                if (Handler.options().ProfileData)
+                    Edit.Count = Handler.options().ProfileData->count(Edit.Function);
+            }
+
+            auto Loc = SM.getExpansionLoc(LoopVar->getLocation());
+            Edit.File = details::GetAbsolutePath(SM.getFileManager(), SM.getFilename(Loc));
+            Edit.Line = SM.getSpellingLineNumber(Loc);
+            Edit.Column = SM.getSpellingColumnNumber(Loc);
+            return Edit;
+        }
+
+        // Число итераций по типу диапазона: массив T[N] и std::array<T, N>; 0 - неизвестно.
+        static uint64_t knownIterations(ASTContext &Ctx, QualType Range)
+        {
+            Range = Range.getNonReferenceType();
+            if (Range->isDependentType())
+                return 0;
+            if (const auto *Array = Ctx.getAsConstantArrayType(Range))
+                return Array->getSize().getZExtValue();
+            const auto *Spec = dyn_cast_or_null<ClassTemplateSpecializationDecl>(Range->getAsCXXRecordDecl());
+            if (!Spec || !Spec->isInStdNamespace() || Spec->getName() != "array")
+                return 0;
+            const auto &Args = Spec->getTemplateArgs();
+            if (Args.size() != 2 || Args[1].getKind() != TemplateArgument::Integral)
+                return 0;
+            return Args[1].getAsIntegral().getZExtValue();
+        }
+
+        std::optional<ASTNameGenerator> Names; // Только с --profile-data или --profile-ranking.
+    };
+
+    // Упоминания переменной внутри оператора: вызовы её методов по имени и прочие обращения,
+    // а также выходы из цикла (break, goto, return), при которых число итераций не известно.
+    class VarUses : public RecursiveASTVisitor<VarUses>
+    {
+    public:
+        explicit VarUses(const VarDecl *Var) : Var(Var) {}
+
+        VarUses &scan(const Stmt *S)
+        {
+            TraverseStmt(const_cast<Stmt *>(S));
+            return *this;
+        }
+
+        bool VisitDeclRefExpr(DeclRefExpr *Ref)
+        {
+            if (Ref->getDecl() == Var)
+                Refs.push_back(Ref);
+            return true;
+        }
+        bool VisitCXXMemberCallExpr(CXXMemberCallExpr *Call)
+        {
+            const auto *Object = Call->getImplicitObjectArgument();
+            const auto *Ref = Object ? dyn_cast<DeclRefExpr>(Object->IgnoreParenImpCasts()) : nullptr;
+            const auto *Method = Call->getMethodDecl();
+            if (Ref && Ref->getDecl() == Var && Method && Method->getIdentifier())
+                ++Calls[Method->getName()];
+            return true;
+        }
+        bool VisitBreakStmt(BreakStmt *)
+        {
+            Exits = true;
+            return true;
+        }
+        bool VisitGotoStmt(GotoStmt *)
+        {
+            Exits = true;
+            return true;
+        }
+        bool VisitReturnStmt(ReturnStmt *)
+        {
+            Exits = true;
+            return true;
+        }
+
+        unsigned calls(llvm::StringRef Method) const { return Calls.lookup(Method); }
+
+        llvm::SmallVector<const DeclRefExpr *, 4> Refs;
+        bool Exits = false;
+
+    private:
+        const VarDecl *Var;
+        llvm::StringMap<unsigned> Calls;
+    };
+
+    // Меняет ли что-нибудь вычисление выражения. Вызовы допускаются только константных методов
+    // (size() и т.п.): выражение повторяется перед циклом.
+    class SideEffects : public RecursiveASTVisitor<SideEffects>
+    {
+    public:
+        static bool in(const Expr *E, ASTContext &Ctx)
+        {
+            if (E->HasSideEffects(Ctx, /*IncludePossibleEffects=*/false))
+                return true;
+            SideEffects Visitor;
+            Visitor.TraverseStmt(const_cast<Expr *>(E));
+            return Visitor.Found;
+        }
+
+        bool VisitCallExpr(CallExpr *Call)
+        {
+            const auto *Method = dyn_cast_or_null<CXXMethodDecl>(Call->getDirectCallee());
+            Found = !Method || !Method->isConst();
+            return !Found;
+        }
+
+    private:
+        bool Found = false;
+    };
+
+    // 4. Заполнение локального std::vector в цикле с известным числом итераций:
+    // перед циклом вставляется 'v.reserve(n);', чтобы вектор не перевыделял память по ходу.
+    class VectorReserveCheck : public RefactorCheck
+    {
+    public:
+        using RefactorCheck::RefactorCheck;
+
+        llvm::StringRef getID() const override { return "vector-reserve"; }
+
+        void registerMatchers(MatchFinder &Finder) override
+        {
+            Finder.addMatcher(traverse(traversalKind(), VectorPushBackLoopMatcher()), this);
+        }
+
+        void check(const MatchFinder::MatchResult &Result) override
+        {
+            const auto *Vector = Result.Nodes.getNodeAs<VarDecl>("vector");
+            const auto *Loop = Result.Nodes.getNodeAs<Stmt>("loop");
+            if (Vector && Loop)
+                handle(Vector, Loop, Result.Nodes.getNodeAs<Expr>("tripCount"), Result.Nodes.getNodeAs<Expr>("range"),
+                       *Result.Context, Result.Context->getDiagnostics(), *Result.SourceManager);
+        }
+
+    private:
+        void handle(const VarDecl *Vector, const Stmt *Loop, const Expr *TripCount, const Expr *Range, ASTContext &Ctx,
+                    DiagnosticsEngine &Diag, SourceManager &SM)
+        {
+            // Шаблон решает сам за себя: в инстанцированиях те же места правки.
+            if (isInInstantiation(Vector) || Vector->getType()->isReferenceType())
+                return;
+            if (!isDefaultConstructed(Vector))
+                return; // в непустом векторе reserve(n) может оказаться меньше итогового размера
+
+            const auto *Block = declaredBefore(Vector, Loop, Ctx);
+            if (!Block)
+                return;
+
+            const Stmt *Body = isa<ForStmt>(Loop) ? cast<ForStmt>(Loop)->getBody() : cast<CXXForRangeStmt>(Loop)->getBody();
+            auto InLoop = VarUses(Vector).scan(Body);
+            if (InLoop.Exits || InLoop.calls("push_back") + InLoop.calls("emplace_back") != 1)
+                return; // число вставок не равно числу итераций
+            const auto *Func = dyn_cast_or_null<FunctionDecl>(Vector->getParentFunctionOrMethod());
+            if (!Func || !Func->getBody() || VarUses(Vector).scan(Func->getBody()).calls("reserve"))
+                return;
+
+            auto Count = TripCount ? countFromCondition(cast<ForStmt>(Loop), TripCount, Vector, Ctx)
+                                   : countFromRange(Range, Vector, Ctx);
+            if (!Count)
+                return;
+
+            auto Loc = Loop->getBeginLoc();
+            if (!Handler.canRewrite(SM, Loc, /*ContextFree=*/true))
+                return;
+            std::string Text = (Vector->getName() + ".reserve(" + *Count + ");" + lineBreak(SM, Loc)).str();
+            if (!Handler.insertText(SM, Loc, Text))
+                return;
+
+            auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Добавлен reserve() перед заполнением вектора");
+            Diag.Report(Loc, DiagID);
+        }
+
+        // Вектор создан пустым: без инициализатора или конструктором без явных аргументов.
+        static bool isDefaultConstructed(const VarDecl *Vector)
+        {
+            const auto *Init = Vector->getInit();
+            if (!Init)
+                return true;
+            const auto *Construct = dyn_cast<CXXConstructExpr>(Init->IgnoreImplicit());
+            return Construct && llvm::all_of(Construct->arguments(), [](const Expr *Arg)
+                                             { return isa<CXXDefaultArgExpr>(Arg); });
+        }
+
+        // Блок, где объявление вектора и цикл - соседние операторы, а между ними вектор не упоминается.
+        const CompoundStmt *declaredBefore(const VarDecl *Vector, const Stmt *Loop, ASTContext &Ctx)
+        {
+            auto Parents = Ctx.getParents(*Loop);
+            const auto *Block = Parents.size() == 1 ? Parents[0].get<CompoundStmt>() : nullptr;
+            if (!Block)
+                return nullptr;
+
+            bool Declared = false;
+            for (const auto *S : Block->body())
+            {
+                if (S == Loop)
+                    return Declared ? Block : nullptr;
+                if (!Declared)
+                {
+                    const auto *Decl = dyn_cast<DeclStmt>(S);
+                    Declared = Decl && llvm::is_contained(Decl->decls(), Vector);
+                }
+                else if (!VarUses(Vector).scan(S).Refs.empty())
+                    return nullptr;
+            }
+            return nullptr;
+        }
+
+        // n из 'for (i = 0; i < n; ++i)'. Выражение повторяется перед циклом, поэтому в нём не должно быть
+        // побочных эффектов, самого вектора и переменных из заголовка цикла. Отрицательное n цикл
+        // просто не выполнит, а reserve бросит length_error - знаковое n допускается только константой.
+        std::optional<std::string> countFromCondition(const ForStmt *Loop, const Expr *TripCount, const VarDecl *Vector,
+                                                      ASTContext &Ctx)
+        {
+            const auto *N = TripCount->IgnoreParenImpCasts();
+            if (!N->getType()->isIntegerType() || N->isValueDependent() || SideEffects::in(N, Ctx))
+                return std::nullopt;
+            if (N->getType()->isSignedIntegerOrEnumerationType())
+            {
+                Expr::EvalResult Value;
+                if (!N->EvaluateAsInt(Value, Ctx) || Value.Val.getInt().isNegative())
+                {
+                    Handler.skip("signed_trip_count");
+                    return std::nullopt;
+                }
+            }
+            if (!VarUses(Vector).scan(N).Refs.empty())
+                return std::nullopt;
+            if (const auto *Init = dyn_cast_or_null<DeclStmt>(Loop->getInit()))
+                for (const auto *D : Init->decls())
+                    if (const auto *Var = dyn_cast<VarDecl>(D); Var && !VarUses(Var).scan(N).Refs.empty())
+                        return std::nullopt;
+            return sourceText(N, Ctx);
+        }
+
+        // Размер диапазона range-for: массив - число элементов, контейнер - 'r.size()'.
+        // Диапазон - переменная или член, чтобы его вычисление перед циклом было тем же самым.
+        std::optional<std::string> countFromRange(const Expr *Range, const VarDecl *Vector, ASTContext &Ctx)
+        {
+            if (!Range)
+                return std::nullopt;
+            const auto *R = Range->IgnoreParenImpCasts();
+            if (!isa<DeclRefExpr, MemberExpr>(R) || SideEffects::in(R, Ctx) || !VarUses(Vector).scan(R).Refs.empty())
+                return std::nullopt;
+            auto Type = R->getType().getNonReferenceType();
+            if (Type->isDependentType())
+                return std::nullopt;
+            if (const auto *Array = Ctx.getAsConstantArrayType(Type))
+                return std::to_string(Array->getSize().getZExtValue());
+
+            const auto *Record = Type->getAsCXXRecordDecl();
+            if (!Record || !(Record = Record->getDefinition()))
+                return std::nullopt;
+            auto Size = Record->lookup(&Ctx.Idents.get("size"));
+            if (llvm::none_of(Size, [](const NamedDecl *D)
+                              { return isa<CXXMethodDecl>(D->getUnderlyingDecl()); }))
+                return std::nullopt; // например, std::forward_list
+            auto Text = sourceText(R, Ctx);
+            if (!Text)
+                return std::nullopt;
+            return *Text + ".size()";
+        }
+
+        std::optional<std::string> sourceText(const Expr *E, ASTContext &Ctx)
+        {
+            auto Range = CharSourceRange::getTokenRange(E->getSourceRange());
+            if (Range.getBegin().isMacroID() || Range.getEnd().isMacroID())
+            {
+                Handler.skip("macro");
+                return std::nullopt;
+            }
+            auto Text = Lexer::getSourceText(Range, Ctx.getSourceManager(), Ctx.getLangOpts());
+            if (Text.empty())
+                return std::nullopt;
+            return Text.str();
+        }
+
+        // Перевод строки с отступом цикла; если перед циклом в строке есть код - пробел.
+        static std::string lineBreak(const SourceManager &SM, SourceLocation Loc)
+        {
+            auto [FID, Offset] = SM.getDecomposedLoc(Loc);
+            llvm::StringRef Before = SM.getBufferData(FID).take_front(Offset);
+            llvm::StringRef Indent = Before.substr(Before.find_last_of('\n') + 1);
+            if (Indent.find_first_not_of(" \t") != llvm::StringRef::npos)
+                return " ";
+            return ("\n" + Indent).str();
+        }
+    };
+
+    // Функции, которые используются не только как вызываемые: адрес взят, передана как значение
+    // (указатель на функцию, член-функцию), упомянута в шаблоне вне вызова. Их сигнатуру менять нельзя.
+    class FunctionRefs : public RecursiveASTVisitor<FunctionRefs>
+    {
+    public:
+        bool shouldVisitTemplateInstantiations() const { return true; }
+
+        void build(ASTContext &Context)
+        {
+            Callees.clear();
+            Taken.clear();
+            TraverseDecl(Context.getTranslationUnitDecl());
+        }
+
+        bool isAddressTaken(const FunctionDecl *Func) const { return Taken.count(origin(Func)); }
+
+        // Вызов обходится раньше вызываемого выражения: его DeclRefExpr уже известен как вызов.
+        bool VisitCallExpr(CallExpr *Call)
+        {
+            if (const auto *Callee = Call->getCallee())
+                Callees.insert(Callee->IgnoreParenImpCasts());
+            return true;
+        }
+        bool VisitDeclRefExpr(DeclRefExpr *Ref)
+        {
+            if (const auto *Func = dyn_cast<FunctionDecl>(Ref->getDecl()); Func && !Callees.count(Ref))
+                Taken.insert(origin(Func));
+            return true;
+        }
+        bool VisitUnresolvedLookupExpr(UnresolvedLookupExpr *Lookup)
+        {
+            if (Callees.count(Lookup))
+                return true;
+            for (const auto *D : Lookup->decls())
+                if (const auto *Func = D->getAsFunction())
+                    Taken.insert(origin(Func));
+            return true;
+        }
+
+    private:
+        // Специализация ('&f<int>') и метод инстанцированного класса сводятся к шаблону, который
+        // видит проверка: правка шаблона меняет тип каждой специализации.
+        static const FunctionDecl *origin(const FunctionDecl *Func)
+        {
+            if (const auto *Primary = Func->getPrimaryTemplate())
+                Func = Primary->getTemplatedDecl();
+            if (const auto *Pattern = Func->getTemplateInstantiationPattern(/*ForDefinition=*/false))
+                Func = Pattern;
+            return Func->getCanonicalDecl();
+        }
+
+        llvm::DenseSet<const Expr *> Callees;
+        llvm::DenseSet<const FunctionDecl *> Taken;
+    };
+
+    // 5. Тяжёлые параметры по значению (дорогая копия, как в range-for-copy). Параметр, который
+    // функция только читает, становится 'const T&' в определении и всех объявлениях, если сигнатуру
+    // не видят другие TU (внутреннее связывание или объявление в правимом заголовке). Параметр,
+    // единственное использование которого - копия в член или локальную переменную, переносится
+    // туда через std::move. Виртуальные функции и функции, используемые не только вызовом, не трогаем.
+    class ValueParamCheck : public RefactorCheck
+    {
+    public:
+        using RefactorCheck::RefactorCheck;
+
+        llvm::StringRef getID() const override { return "value-param"; }
+
+        void registerMatchers(MatchFinder &Finder) override
+        {
+            Finder.addMatcher(traverse(traversalKind(), ValueParamFunctionMatcher()), this);
+        }
+
+        // Адрес функции может быть взят в любом месте TU, в том числе в заголовке.
+        void prepare(ASTContext &Context) override { Refs.build(Context); }
+
+        void check(const MatchFinder::MatchResult &Result) override
+        {
+            if (const auto *Func = Result.Nodes.getNodeAs<FunctionDecl>("function"))
+                handle(Func, *Result.Context, Result.Context->getDiagnostics(), *Result.SourceManager);
+        }
+
+    private:
+        void handle(const FunctionDecl *Func, ASTContext &Ctx, DiagnosticsEngine &Diag, SourceManager &SM)
+        {
+            // Шаблон решает сам за себя; у лямбд, операторов (копирование с обменом) и функций
+            // с C-связыванием сигнатура задана снаружи; параметры сопрограммы живут в её кадре.
+            if (Func->isTemplateInstantiation() || Func->getTemplateInstantiationPattern() || Func->isMain() ||
+                Func->isExternC() || Func->isOverloadedOperator() || !Func->getBody() ||
+                isa<CoroutineBodyStmt>(Func->getBody()))
+                return;
+            if (const auto *Method = dyn_cast<CXXMethodDecl>(Func); Method && Method->getParent()->isLambda())
+                return;
+
+            std::optional<ExprMutationAnalyzer> BodyMutations;
+            for (unsigned I = 0; I < Func->getNumParams(); ++I)
+            {
+                const auto *Param = Func->getParamDecl(I);
+                const auto *Record = Param->getType()->getAsCXXRecordDecl();
+                if (!Record || Param->getType()->isDependentType() || !isCopyable(Record) ||
+                    !isExpensiveCopy(Param->getType(), Ctx, Handler.options().CopyThreshold).value_or(false))
+                    continue;
+                if (!Handler.canRewrite(SM, Param->getLocation(), /*ContextFree=*/false))
+                    continue;
+
+                VarUses Uses(Param);
+                Uses.scan(Func->getBody());
+                if (const auto *Ctor = dyn_cast<CXXConstructorDecl>(Func))
+                    for (const auto *Init : Ctor->inits())
+                        if (Init->isWritten())
+                            Uses.scan(Init->getInit());
+
+                // Из const-параметра std::move всё равно скопирует. Без объявленного std::move
+                // копию оставляем, а параметр может стать 'const T&' по общим правилам.
+                if (!Param->getType().isConstQualified() && !Param->getType().isTriviallyCopyableType(Ctx) &&
+                    Uses.Refs.size() == 1)
+                    if (const auto *Copy = copySource(Uses.Refs.front(), Func, Ctx);
+                        Copy && isStdMoveDeclared(Ctx, SM, Copy->getBeginLoc()))
+                    {
+                        moveInto(Copy, SM, Diag);
+                        continue;
+                    }
+
+                if (!BodyMutations)
+                    BodyMutations.emplace(*Func->getBody(), Ctx);
+                if (BodyMutations->isMutated(Param) || isMutatedInInits(Func, Param, Ctx) ||
+                    llvm::any_of(Uses.Refs, [&](const DeclRefExpr *Ref)
+                                 { return isReturned(Ref, Ctx); }))
+                {
+                    Handler.skip("mutated_param"); // или возвращается: копия нужна всё равно
+                    continue;
+                }
+                // Сигнатура меняется, а вызовы и указатели на функцию в других TU этого не видят.
+                if (!signatureIsLocal(Func, SM))
+                {
+                    Handler.skip("external_linkage");
+                    continue;
+                }
+                if (Refs.isAddressTaken(Func))
+                {
+                    Handler.skip("address_taken");
+                    continue;
+                }
+                passByConstRef(Func, I, SM, Diag);
+            }
+        }
+
+        // Сигнатуру видит только эта TU: внутреннее связывание или первое объявление в заголовке,
+        // который правится вместе с определением. Функция, объявленная лишь в .cpp, может быть
+        // объявлена заново или взята по адресу в другой TU, и после правки там не слинкуется.
+        bool signatureIsLocal(const FunctionDecl *Func, SourceManager &SM)
+        {
+            if (!Func->isExternallyVisible())
+                return true;
+            auto Loc = Func->getFirstDecl()->getLocation();
+            return !SM.isInMainFile(SM.getExpansionLoc(Loc)) && Handler.isEditableFile(SM, Loc);
+        }
+
+        // Копирование доступно: иначе параметр по значению - намеренный приём владения.
+        static bool isCopyable(const CXXRecordDecl *Record)
+        {
+            Record = Record->getDefinition();
+            if (!Record)
+                return false;
+            if (Record->needsImplicitCopyConstructor())
+                return !Record->defaultedCopyConstructorIsDeleted();
+            return llvm::any_of(Record->ctors(), [](const CXXConstructorDecl *Ctor)
+                                { return Ctor->isCopyConstructor() && !Ctor->isDeleted(); });
+        }
+
+        static bool isMutatedInInits(const FunctionDecl *Func, const ParmVarDecl *Param, ASTContext &Ctx)
+        {
+            const auto *Ctor = dyn_cast<CXXConstructorDecl>(Func);
+            return Ctor && llvm::any_of(Ctor->inits(), [&](const CXXCtorInitializer *Init)
+                                        { return Init->isWritten() &&
+                                                 ExprMutationAnalyzer(*Init->getInit(), Ctx).isMutated(Param); });
+        }
+
+        // Одноаргументный std::move (<utility>) объявлен до Loc. Включение не добавляется: его место
+        // среди #include решает проект, а std::move из <algorithm> принимает три аргумента.
+        // Правка в заголовке попадёт во все включающие его TU, поэтому там объявление должно прийти
+        // через #include самого заголовка, а не TU, включившей <utility> раньше. Если <utility> уже
+        // был включён до заголовка, его повторное включение пропускается и цепочки нет - правка
+        // тогда не делается, хотя и могла бы.
+        static bool isStdMoveDeclared(ASTContext &Ctx, SourceManager &SM, SourceLocation Loc)
+        {
+            auto Target = SM.getFileID(SM.getExpansionLoc(Loc));
+            auto IsReachable = [&](SourceLocation Decl)
+            {
+                if (SM.isInMainFile(Loc))
+                    return true;
+                for (auto File = SM.getFileID(SM.getExpansionLoc(Decl)); File.isValid();)
+                {
+                    if (File == Target)
+                        return true;
+                    auto Include = SM.getIncludeLoc(File);
+                    File = Include.isValid() ? SM.getFileID(Include) : FileID();
+                }
+                return false;
+            };
+
+            for (const auto *Std : Ctx.getTranslationUnitDecl()->lookup(&Ctx.Idents.get("std")))
+            {
+                const auto *Namespace = dyn_cast<NamespaceDecl>(Std);
+                if (!Namespace)
+                    continue;
+                // Члены встроенного пространства (std::__1 в libc++) видны в std.
+                for (const auto *Move : Namespace->lookup(&Ctx.Idents.get("move")))
+                {
+                    const auto *Template = dyn_cast<FunctionTemplateDecl>(Move);
+                    if (Template && Template->getTemplatedDecl()->getNumParams() == 1 &&
+                        SM.isBeforeInTranslationUnit(Template->getLocation(), Loc) &&
+                        IsReachable(Template->getLocation()))
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        // Ближайший родитель выражения, не считая неявных преобразований и скобок.
+        static DynTypedNode consumer(const Expr *E, ASTContext &Ctx)
+        {
+            DynTypedNode Node = DynTypedNode::create(*E);
+            while (true)
+            {
+                auto Parents = Ctx.getParents(Node);
+                if (Parents.size() != 1)
+                    return {};
+                const auto *Parent = Parents[0].get<Expr>();
+                if (!Parent || !isa<ImplicitCastExpr, ParenExpr, MaterializeTemporaryExpr, CXXBindTemporaryExpr,
+                                    ExprWithCleanups>(Parent))
+                    return Parents[0];
+                Node = Parents[0];
+            }
+        }
+
+        // 'return p;' - неявное перемещение параметра; через const& оно стало бы копией.
+        static bool isReturned(const DeclRefExpr *Ref, ASTContext &Ctx)
+        {
+            auto Use = consumer(Ref, Ctx);
+            if (const auto *Construct = Use.get<CXXConstructExpr>())
+                Use = consumer(Construct, Ctx);
+            return Use.get<ReturnStmt>();
+        }
+
+        // Ref - копируемое значение: аргумент копирующего конструктора (инициализация члена или
+        // переменной) или копирующего присваивания, выполняемых один раз - не в цикле и не в лямбде.
+        static const DeclRefExpr *copySource(const DeclRefExpr *Ref, const FunctionDecl *Func, ASTContext &Ctx)
+        {
+            auto Use = consumer(Ref, Ctx);
+            bool IsCopy = false;
+            if (const auto *Construct = Use.get<CXXConstructExpr>())
+                IsCopy = Construct->getConstructor()->isCopyConstructor() && Construct->getNumArgs() >= 1;
+            else if (const auto *Assign = Use.get<CXXOperatorCallExpr>())
+            {
+                const auto *Method = dyn_cast_or_null<CXXMethodDecl>(Assign->getDirectCallee());
+                IsCopy = Method && Method->isCopyAssignmentOperator() && Assign->getNumArgs() == 2 &&
+                         Assign->getArg(1)->IgnoreParenImpCasts() == Ref;
+            }
+            if (!IsCopy)
+                return nullptr;
+
+            for (auto Node = Use;;)
+            {
+                auto Parents = Ctx.getParents(Node);
+                if (Parents.size() != 1)
+                    return nullptr;
+                Node = Parents[0];
+                if (Node.get<CXXCtorInitializer>() || Node.get<FunctionDecl>() == Func)
+                    return Ref;
+                if (const auto *S = Node.get<Stmt>();
+                    S && isa<ForStmt, CXXForRangeStmt, WhileStmt, DoStmt, LambdaExpr>(S))
+                    return nullptr;
+                if (!Node.get<Stmt>() && !Node.get<VarDecl>())
+                    return nullptr;
+            }
+        }
+
+        void moveInto(const DeclRefExpr *Ref, SourceManager &SM, DiagnosticsEngine &Diag)
+        {
+            auto Begin = Ref->getBeginLoc();
+            auto End = Lexer::getLocForEndOfToken(Ref->getEndLoc(), 0, SM, Ref->getDecl()->getASTContext().getLangOpts());
+            if (!Begin.isFileID() || !End.isFileID())
+            {
+                Handler.skip("macro");
+                return;
+            }
+            if (!Handler.canRewrite(SM, Begin, /*ContextFree=*/true))
+                return;
+            if (!Handler.insertText(SM, Begin, "std::move(") || !Handler.insertText(SM, End, ")"))
+                return;
+
+            auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Копия параметра заменена на std::move");
+            Diag.Report(Begin, DiagID);
+        }
+
+        // 'T p' -> 'const T& p' в определении и во всех объявлениях; места проверяются до первой вставки.
+        void passByConstRef(const FunctionDecl *Func, unsigned Index, SourceManager &SM, DiagnosticsEngine &Diag)
+        {
+            struct Edit
+            {
+                SourceLocation Const; // невалидный, если тип уже const
+                SourceLocation Ref;
+            };
+            llvm::SmallVector<Edit, 2> Edits;
+            const auto &LangOpts = Func->getASTContext().getLangOpts();
+            for (const auto *Redecl : Func->redecls())
+            {
+                const auto *Param = Redecl->getParamDecl(Index);
+                if (!Param->getTypeSourceInfo())
+                    return;
+                auto TL = Param->getTypeSourceInfo()->getTypeLoc();
+                Edit E;
+                if (!Param->getType().isConstQualified())
+                    E.Const = TL.getBeginLoc();
+                E.Ref = Lexer::getLocForEndOfToken(TL.getEndLoc(), 0, SM, LangOpts);
+                if (E.Ref.isInvalid() || !E.Ref.isFileID() || (E.Const.isValid() && !E.Const.isFileID()))
+                {
+                    Handler.skip("macro");
+                    return;
+                }
+                if (!Handler.canRewrite(SM, E.Ref, /*ContextFree=*/false))
+                    return; // объявление в заголовке, который нельзя править
+                Edits.push_back(E);
+            }
+
+            for (const auto &E : Edits)
+            {
+                if (E.Const.isValid() && !Handler.insertText(SM, E.Const, "const "))
+                    return;
+                if (!Handler.insertText(SM, E.Ref, "&"))
+                    return;
+            }
+
+            const auto *Param = Func->getParamDecl(Index);
+            auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Параметр по значению заменён на const&");
+            Diag.Report(Param->getLocation(), DiagID);
+        }
+
+        FunctionRefs Refs;
+    };
+
+    template <typename Check>
+    std::unique_ptr<RefactorCheck> create(RefactorHandler &Handler)
+    {
+        return std::make_unique<Check>(Handler);
+    }
+
+    // Правка nv-dtor - в объявлении деструктора ('~' или альтернативное 'compl'), override - в
+    // методе внутри определения класса, range-for-copy - в заголовке цикла for, vector-reserve - перед
+    // циклом for. Сам push_back/emplace_back может прийти из макроса заголовка (APPEND(v, i)),
+    // поэтому vector-reserve ищет только ключевое слово цикла. Базовые классы могут быть
+    // в заголовках, поэтому 'virtual' и ':' в главном файле не обязательны. Для value-param
+    // лексем нет: параметр класса по значению по тексту не отличить, и фильтр с ней отключается.
+    const llvm::StringLiteral NvDtorTokens[] = {"~", "compl"};
+    const llvm::StringLiteral OverrideTokens[] = {"class", "struct"};
+    const llvm::StringLiteral LoopTokens[] = {"for"};
+
+    // Имена совпадают с getID() проверок.
+    const CheckInfo Registry[] = {
+        {"nv-dtor", "'virtual' у деструктора базового класса с наследниками", create<NvDtorCheck>, NvDtorTokens},
+        {"override", "'override' у методов, переопределяющих виртуальные", create<OverrideCheck>, OverrideTokens},
+        {"range-for-copy", "'&' (и 'const', если копия не меняется) у переменной range-for с дорогой копией",
+         create<RangeForCopyCheck>, LoopTokens},
+        {"vector-reserve", "'v.reserve(n);' перед циклом, заполняющим локальный std::vector",
+         create<VectorReserveCheck>, LoopTokens},
+        {"value-param", "'const T&' вместо тяжёлого параметра по значению или std::move его единственной копии",
+         create<ValueParamCheck>, /*AnyOfTokens=*/{}, /*OptIn=*/true},
+    };
+} // namespace
+
+llvm::ArrayRef<CheckInfo> registeredChecks()
+{
+    return Registry;
+}
+
+llvm::Expected<std::vector<std::string>> parseCheckList(llvm::StringRef List)
+{
+    llvm::SmallVector<llvm::StringRef, 4> Names;
+    List.split(Names, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+
+    std::vector<std::string> Result;
+    for (auto Name : Names)
+    {
+        Name = Name.trim();
+        if (Name.empty())
+            continue;
+        if (llvm::none_of(registeredChecks(), [&](const CheckInfo &Info)
+                          { return Info.Name == Name; }))
+        {
+            std::string Known;
+            for (const auto &Info : registeredChecks())
+                Known += (Known.empty() ? "" : ", ") + Info.Name.str();
+            return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                           "unknown check '" + Name.str() + "' (known: " + Known + ")");
+        }
+        if (!llvm::is_contained(Result, Name))
+            Result.push_back(Name.str());
+    }
+    return Result;
+}
@@ -0,0 +1,163 @@
+#include "RefactorPlugin.h"
+#include "RefactorCheck.h"
+#include "EditCollector.h"
+
+#include "clang/AST/ASTConsumer.h"
+#include "clang/AST/ASTContext.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendPluginRegistry.h"
+#include "clang/Rewrite/Core/Rewriter.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Regex.h"
+#include "llvm/Support/xxhash.h"
+
+using namespace clang;
+using namespace clang::tooling;
+
+namespace
+{
+    void report(DiagnosticsEngine &Diag, DiagnosticsEngine::Level Level, llvm::StringRef Message)
+    {
+        Diag.Report(Diag.getCustomDiagID(Level, "refactor plugin: %0")) << Message;
+    }
+
+    // Прогоняет проверки после основного действия и записывает правки TU.
+    // Rewriter нужен проверкам для вычисления мест вставки, его буферы никуда не выгружаются.
+    class PluginConsumer : public ASTConsumer
+    {
+    public:
+        PluginConsumer(CompilerInstance &CI, const RefactorOptions &Options, std::string MainFile,
+                       std::string FixesPath)
+            : Rewrite(CI.getSourceManager(), CI.getLangOpts()), MainFile(std::move(MainFile)),
+              FixesPath(std::move(FixesPath)), Inner(Rewrite, Edits, Options)
+        {
+        }
+
+        bool HandleTopLevelDecl(DeclGroupRef Group) override { return Inner.HandleTopLevelDecl(Group); }
+
+        void HandleTranslationUnit(ASTContext &Context) override
+        {
+            // С ошибками компиляции объектный файл не появится, правки по неполному AST не нужны.
+            auto &Diag = Context.getDiagnostics();
+            if (Diag.hasErrorOccurred())
+                return;
+
+            Inner.HandleTranslationUnit(Context);
+
+            auto &FM = Context.getSourceManager().getFileManager();
+            std::vector<Replacement> Absolute;
+            for (const auto &Edit : Edits)
+                Absolute.emplace_back(details::GetAbsolutePath(FM, Edit.getFilePath()), Edit.getOffset(),
+                                      Edit.getLength(), Edit.getReplacementText());
+
+            // Файл пишется и без правок: так он заменяет правки прошлой сборки этой TU.
+            if (auto Err = exportFixes(FixesPath, Absolute, MainFile))
+                report(Diag, DiagnosticsEngine::Warning,
+                       "cannot write " + FixesPath + ": " + llvm::toString(std::move(Err)));
+        }
+
+    private:
+        Rewriter Rewrite;
+        std::vector<Replacement> Edits;
+        std::string MainFile;
+        std::string FixesPath;
+        ComplexConsumer Inner;
+    };
+} // namespace
+
+bool RefactorPluginAction::ParseArgs(const CompilerInstance &CI, const std::vector<std::string> &Args)
+{
+    for (const auto &Arg : Args)
+    {
+        auto [Key, Value] = llvm::StringRef(Arg).split('=');
+        if (Key == "fixes")
+            FixesPath = Value.str();
+        else if (Key == "fixes-dir")
+            FixesDir = Value.str();
+        else if (Key == "checks")
+        {
+            auto Checks = parseCheckList(Value);
+            if (!Checks)
+            {
+                report(CI.getDiagnostics(), DiagnosticsEngine::Error,
+                       "invalid checks: " + llvm::toString(Checks.takeError()));
+                return false;
+            }
+            Options.Checks = std::move(*Checks);
+        }
+        else if (Key == "header-filter")
+        {
+            std::string Error;
+            if (!llvm::Regex(Value).isValid(Error))
+            {
+                report(CI.getDiagnostics(), DiagnosticsEngine::Error, "invalid header-filter: " + Error);
+                return false;
+            }
+            Options.HeaderFilter = Value.str();
+        }
+        else if (Key == "copy-threshold")
+        {
+            if (Value.getAsInteger(10, Options.CopyThreshold))
+            {
+                report(CI.getDiagnostics(), DiagnosticsEngine::Error, "invalid copy-threshold '" + Value.str() + "'");
+                return false;
+            }
+        }
+        else if (Arg == "limit-traversal")
+            Options.LimitTraversal = true;
+        else if (Arg == "skip-instantiations")
+            Options.SkipInstantiations = true;
+        else
+        {
+            report(CI.getDiagnostics(), DiagnosticsEngine::Error, "unknown argument '" + Arg + "'");
+            return false;
+        }
+    }
+    if (!FixesPath.empty() && !FixesDir.empty())
+    {
+        report(CI.getDiagnostics(), DiagnosticsEngine::Error, "fixes and fixes-dir are mutually exclusive");
+        return false;
+    }
+    return true;
+}
+
+std::string RefactorPluginAction::fixesPathFor(CompilerInstance &CI, llvm::StringRef MainFile) const
+{
+    if (!FixesPath.empty())
+        return FixesPath;
+
+    if (!FixesDir.empty())
+    {
+        // Одноимённые файлы из разных каталогов различаются хэшем полного пути.
+        llvm::sys::fs::create_directories(FixesDir);
+        llvm::SmallString<256> Path(FixesDir);
+        llvm::sys::path::append(Path, llvm::sys::path::filename(MainFile) + "-" +
+                                          llvm::utohexstr(llvm::xxh3_64bits(llvm::arrayRefFromStringRef(MainFile)),
+                                                          /*LowerCase=*/true) +
+                                          ".yaml");
+        return std::string(Path);
+    }
+
+    llvm::StringRef Output = CI.getFrontendOpts().OutputFile;
+    if (Output.empty() || Output == "-")
+        return {};
+    return (Output + ".fixes.yaml").str();
+}
+
+std::unique_ptr<ASTConsumer> RefactorPluginAction::CreateASTConsumer(CompilerInstance &CI, llvm::StringRef InFile)
+{
+    std::string MainFile = details::GetAbsolutePath(CI.getFileManager(), InFile);
+    std::string Path = fixesPathFor(CI, MainFile);
+    if (Path.empty())
+    {
+        report(CI.getDiagnostics(), DiagnosticsEngine::Warning,
+               "no object file to put fixes next to, use fixes=<file> or fixes-dir=<dir>");
+        return std::make_unique<ASTConsumer>();
+    }
+    return std::make_unique<PluginConsumer>(CI, Options, std::move(MainFile), std::move(Path));
+}
+
+static FrontendPluginRegistry::Add<RefactorPluginAction>
+    RegisterRefactorPlugin("refactor", "Add virtual/override/& and write the fixes as YAML");
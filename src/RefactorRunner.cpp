@@ -0,0 +1,500 @@
+#include "RefactorRunner.h"
+#include "RefactorTool.h"
+#include "ChangesWriter.h"
+#include "HierarchySummary.h"
+#include "ResultCache.h"
+#include "EditCollector.h"
+#include "PreambleCache.h"
+#include "LexicalPrefilter.h"
+#include "IncludeGraph.h"
+#include "ProfileData.h"
+#include "TUScheduler.h"
+
+#include "clang/Frontend/PCHContainerOperations.h"
+#include "clang/Tooling/ArgumentsAdjusters.h"
+#include "clang/Tooling/Core/Replacement.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Chrono.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/VirtualFileSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace clang;
+using namespace clang::tooling;
+
+namespace
+{
+    std::string absolutePath(llvm::StringRef Path)
+    {
+        llvm::SmallString<256> Abs(Path);
+        llvm::sys::fs::make_absolute(Abs);
+        llvm::sys::path::remove_dots(Abs, /*remove_dot_dot=*/true);
+        return std::string(Abs);
+    }
+} // namespace
+
+RefactorSession::RefactorSession(const CompilationDatabase &Compilations, RunOptions Options)
+    : Compilations(Compilations), Options(std::move(Options)),
+      PCHContainerOps(std::make_shared<PCHContainerOperations>())
+{
+    // Кэши используются только для рефакторинга, сводкам иерархии они не нужны.
+    if (!this->Options.CacheDir.empty() && this->Options.EmitHierarchyDir.empty())
+        Cache.emplace(this->Options.CacheDir);
+    if (!this->Options.PreambleDir.empty() && this->Options.EmitHierarchyDir.empty())
+        Preambles.emplace(this->Options.PreambleDir);
+}
+
+std::vector<std::string> RefactorSession::refresh()
+{
+    std::set<std::string> Changed;
+    for (auto &W : Workers)
+    {
+        if (!W.Files)
+            continue;
+        llvm::SmallVector<OptionalFileEntryRef> Known;
+        W.Files->GetUniqueIDMapping(Known);
+        bool Stale = false;
+        for (auto Entry : Known)
+        {
+            if (!Entry)
+                continue;
+            // Имя в FileManager может быть относительным к каталогу компиляции, путь
+            // после открытия файла - абсолютный.
+            llvm::StringRef Path = Entry->getFileEntry().tryGetRealPathName();
+            if (Path.empty())
+                Path = Entry->getName();
+            llvm::sys::fs::file_status Status;
+            bool Exists = !llvm::sys::fs::status(Path, Status);
+            if (Exists && Status.getSize() == static_cast<uint64_t>(Entry->getSize()) &&
+                llvm::sys::toTimeT(Status.getLastModificationTime()) == Entry->getModificationTime())
+                continue;
+            Stale = true;
+            Changed.insert(absolutePath(Path));
+        }
+        if (Stale)
+            W.Files = nullptr;
+    }
+    return std::vector<std::string>(Changed.begin(), Changed.end());
+}
+
+void RefactorSession::warmPreamble(llvm::StringRef File)
+{
+    if (!Preambles)
+        return;
+    auto Commands = Compilations.getCompileCommands(File);
+    std::string MainPath = absolutePath(File);
+    auto Buf = llvm::MemoryBuffer::getFile(MainPath);
+    if (Commands.size() == 1 && Buf)
+        Preambles->get(Commands.front(), MainPath, (*Buf)->getBuffer());
+}
+
+int RefactorSession::run(llvm::ArrayRef<std::string> SourcePaths)
+{
+    // Порядок и повторы в списке файлов не должны влиять на результат.
+    std::vector<std::string> Files(SourcePaths.begin(), SourcePaths.end());
+    llvm::sort(Files);
+    Files.erase(std::unique(Files.begin(), Files.end()), Files.end());
+
+    unsigned Jobs = Options.Jobs ? Options.Jobs : llvm::hardware_concurrency().compute_thread_count();
+    Jobs = std::max(1u, std::min<unsigned>(Jobs, Files.size()));
+
+    // Самые дорогие TU - первыми (LPT): иначе большая TU, взятая последней, одна задаёт
+    // время всего запуска. Потоки разбирают общую очередь, поэтому простаивающих нет,
+    // пока в ней есть работа.
+    std::optional<TimingHistory> Timings;
+    std::mutex TimingsMutex;
+    if (!Options.TimingsFile.empty())
+    {
+        if (auto Loaded = TimingHistory::load(Options.TimingsFile))
+            Timings = std::move(*Loaded);
+        else
+        {
+            llvm::errs() << "Ignoring timings: " << llvm::toString(Loaded.takeError()) << "\n";
+            Timings.emplace();
+        }
+    }
+    if (Jobs > 1)
+        Files = scheduleLargestFirst(Files, Timings ? &*Timings : nullptr);
+
+    if (!Options.EmitHierarchyDir.empty())
+        if (auto EC = llvm::sys::fs::create_directories(Options.EmitHierarchyDir))
+        {
+            llvm::errs() << "Cannot create " << Options.EmitHierarchyDir << ": " << EC.message() << "\n";
+            return 1;
+        }
+
+    // Файлы могли измениться после прошлого запуска: устаревшие FileManager'ы сбрасываем.
+    refresh();
+    if (Workers.size() < Jobs)
+        Workers.resize(Jobs);
+    for (auto &W : Workers)
+    {
+        if (!W.FS)
+            W.FS = llvm::vfs::createPhysicalFileSystem();
+        if (!W.Files)
+            W.Files = llvm::makeIntrusiveRefCnt<FileManager>(FileSystemOptions(), W.FS);
+    }
+
+    // Наследники из других TU нужны для баз, объявленных в заголовках: без --header-filter
+    // их деструкторы не правились бы, поэтому с иерархией правятся все несистемные заголовки.
+    RefactorOptions Refactor = Options.Refactor;
+    if (Refactor.Hierarchy && Refactor.HeaderFilter.empty())
+        Refactor.HeaderFilter = ".*";
+    const uint64_t Fingerprint = Refactor.fingerprint();
+
+    // Общие для всех TU заголовки: правки, не зависящие от TU, вычисляются один раз.
+    // С кэшем результатов - нет: правку заголовка сохранила бы только TU, захватившая его,
+    // и при попадании в кэш остальных TU без неё правка бы пропала. Повторы схлопнет слияние.
+    HeaderClaims Claims;
+    if (!Refactor.HeaderFilter.empty() && !Refactor.Claims && !Cache)
+        Refactor.Claims = &Claims;
+
+    // В отчёт --profile попадают только разобранные TU: попадания в кэш ничего не стоят.
+    // Статистика (--stats) учитывает и попадания в кэш, и TU с ошибками.
+    const bool Stats = !Options.StatsReport.empty();
+    const bool Profile = !Options.ProfileReport.empty() || Stats;
+    Refactor.Profile = Refactor.Profile || Profile;
+    Refactor.CountNodes = Refactor.CountNodes || Stats;
+    std::mutex ProfilesMutex;
+    std::vector<TUProfile> Profiles;
+    // Отчёт пишется в конце запуска, а журнал - по мере обработки TU: запуск, убитый
+    // по нехватке памяти, оставляет хотя бы его.
+    std::unique_ptr<StatsJournal> Journal;
+    if (Stats)
+    {
+        if (auto Created = StatsJournal::create(Options.StatsReport))
+            Journal = std::move(*Created);
+        else
+            llvm::errs() << "Cannot write stats journal: " << llvm::toString(Created.takeError()) << "\n";
+    }
+    auto addProfile = [&](TUProfile P, llvm::StringRef File, llvm::StringRef Status)
+    {
+        P.File = absolutePath(File);
+        P.Status = Status.str();
+        if (Journal)
+            Journal->finished(P);
+        std::lock_guard<std::mutex> Lock(ProfilesMutex);
+        Profiles.push_back(std::move(P));
+    };
+    unsigned Duplicates = 0, Conflicts = 0;
+
+    // Правки всех TU собираются и объединяются: одинаковые правки в общих заголовках
+    // схлопываются, и каждый файл записывается один раз в конце запуска.
+    // В режиме --export-fixes они выгружаются в YAML, исходники не меняются.
+    const bool Export = !Options.ExportFixes.empty();
+    EditCollector Collector;
+
+    // --prefilter: TU, в главном файле которых нет ни одной лексемы включённых проверок,
+    // не разбираются вовсе.
+    std::optional<LexicalPrefilter> Prefilter;
+    if (Options.Prefilter && Options.EmitHierarchyDir.empty())
+        Prefilter.emplace(Refactor);
+    std::atomic<unsigned> Prefiltered{0};
+
+    // Граф включений обновляется по разобранным TU. Попадания в кэш и TU с ошибками
+    // сохраняют прежнюю запись (или её отсутствие - тогда TU считается затронутой).
+    std::optional<IncludeGraph> Graph;
+    std::mutex GraphMutex;
+    if (!Options.IncludeGraphPath.empty() && Options.EmitHierarchyDir.empty())
+    {
+        auto Loaded = IncludeGraph::load(Options.IncludeGraphPath);
+        if (!Loaded)
+        {
+            llvm::errs() << "Ignoring include graph: " << llvm::toString(Loaded.takeError()) << "\n";
+            Graph.emplace();
+        }
+        else
+            Graph = std::move(*Loaded);
+    }
+
+    EditRanking Ranking;
+    if (!Options.ProfileRanking.empty() && !Refactor.Ranking)
+        Refactor.Ranking = &Ranking;
+
+    ChangesWriter Writer;
+    std::atomic<size_t> Next{0};
+    std::atomic<int> Result{0};
+
+    auto Worker = [&](WorkerState &W)
+    {
+        // FileManager потока переживает запуск: заголовки, уже прочитанные и проверенные
+        // для прошлых TU, не перечитываются, пока refresh не обнаружит их изменение.
+        for (size_t I = Next++; I < Files.size(); I = Next++)
+        {
+            const auto &File = Files[I];
+            ClangTool Tool(Compilations, {File}, PCHContainerOps, W.FS, W.Files);
+
+            if (!Options.EmitHierarchyDir.empty())
+            {
+                if (Tool.run(newHierarchySummaryActionFactory(Options.EmitHierarchyDir).get()))
+                {
+                    W.Files = llvm::makeIntrusiveRefCnt<FileManager>(FileSystemOptions(), W.FS);
+                    Result = 1;
+                }
+                continue;
+            }
+
+            std::optional<std::string> Key;
+            std::string MainPath, MainContent;
+            auto Commands = Compilations.getCompileCommands(File);
+            if (Cache || Preambles)
+            {
+                MainPath = absolutePath(File);
+                if (auto Buf = llvm::MemoryBuffer::getFile(MainPath))
+                    MainContent = (*Buf)->getBuffer().str();
+            }
+            if (Prefilter && Prefilter->enabled())
+            {
+                // Уже прочитанное для кэшей содержимое используем повторно. Непрочитанный
+                // файл не отбрасываем: ошибку сообщит разбор.
+                bool MayEdit = !MainContent.empty() ? Prefilter->mayProduceEdits(MainContent)
+                                                    : Prefilter->mayProduceEditsInFile(absolutePath(File)).value_or(true);
+                if (!MayEdit)
+                {
+                    ++Prefiltered;
+                    if (Stats)
+                        addProfile(TUProfile(), File, "prefiltered");
+                    continue;
+                }
+            }
+            // При -j 1 пик памяти сбрасывается перед каждой TU и относится только к ней.
+            std::optional<RSSProbe> Memory;
+            if (Stats)
+                Memory.emplace(/*ResetPeak=*/Jobs == 1);
+            if (Cache && !MainContent.empty() && !Refactor.Ranking)
+            {
+                Key = ResultCache::computeKey(Commands, MainContent, Fingerprint);
+                if (auto Edits = Cache->lookup(*Key))
+                {
+                    // TU не менялась - разбор не нужен, воспроизводим сохранённые правки.
+                    Collector.add(*Edits);
+                    if (Stats)
+                    {
+                        TUProfile Cached;
+                        Cached.EditsApplied = Edits->size();
+                        Memory->finish(Cached);
+                        addProfile(std::move(Cached), File, "cached");
+                    }
+                    continue;
+                }
+            }
+
+            if (Journal)
+                Journal->started(absolutePath(File));
+
+            std::optional<PreambleCache::Preamble> Preamble;
+            if (Preambles && Commands.size() == 1 && !MainContent.empty())
+                Preamble = Preambles->get(Commands.front(), MainPath, MainContent);
+
+            auto ParseStart = std::chrono::steady_clock::now();
+            TUResult TU;
+            bool Failed = true;
+            if (Preamble)
+            {
+                Tool.appendArgumentsAdjuster(
+                    getInsertArgumentAdjuster(Preamble->ExtraArgs, ArgumentInsertPosition::BEGIN));
+                CodeRefactorActionFactory Factory(nullptr, Refactor, &TU);
+                Failed = Tool.run(&Factory);
+                if (!Failed)
+                {
+                    Preambles->noteUsed(*Preamble);
+                    TU.Dependencies.insert(TU.Dependencies.end(), Preamble->Dependencies.begin(),
+                                           Preamble->Dependencies.end());
+                }
+                else
+                    TU = TUResult();
+            }
+            if (Failed)
+            {
+                // Без PCH или после неудачи с ним - обычный разбор. Если он проходит,
+                // виноват PCH (например, заголовок без include guard'а): больше его не используем.
+                ClangTool PlainTool(Compilations, {File}, PCHContainerOps, W.FS, W.Files);
+                CodeRefactorActionFactory Factory(nullptr, Refactor, &TU);
+                Failed = PlainTool.run(&Factory);
+                if (!Failed && Preamble)
+                    Preambles->invalidate(*Preamble);
+            }
+            if (Timings)
+            {
+                std::lock_guard<std::mutex> Lock(TimingsMutex);
+                Timings->record(absolutePath(File),
+                                std::chrono::duration<double>(std::chrono::steady_clock::now() - ParseStart).count());
+            }
+            if (Failed)
+            {
+                // FileManager мог запомнить неудачный поиск заголовка, который потом появится.
+                W.Files = llvm::makeIntrusiveRefCnt<FileManager>(FileSystemOptions(), W.FS);
+                Result = 1;
+                if (Stats)
+                {
+                    Memory->finish(TU.Profile);
+                    addProfile(std::move(TU.Profile), File, "failed");
+                }
+                continue; // результат TU с ошибками не применяем и не кэшируем
+            }
+            Collector.add(TU.Edits);
+            // Заголовки занимаются только принятой TU: неудачная попытка (в том числе с PCH
+            // преамбулы перед обычным разбором) их не держит.
+            if (Refactor.Claims)
+                Refactor.Claims->commit(TU.ClaimedHeaders);
+            if (Refactor.Ranking)
+                for (auto &Candidate : TU.Ranked)
+                    Refactor.Ranking->add(std::move(Candidate));
+            if (Graph)
+            {
+                std::lock_guard<std::mutex> Lock(GraphMutex);
+                Graph->update(File, Commands, TU.Dependencies);
+            }
+            if (Memory)
+                Memory->finish(TU.Profile);
+            if (Profile)
+                addProfile(std::move(TU.Profile), File, "parsed");
+            if (!Key)
+                continue;
+
+            Cache->store(*Key, TU.Dependencies, TU.Edits);
+
+            // Правки идемпотентны: повторный запуск на исправленном файле ничего не меняет.
+            // Сохраняем пустой результат и для нового содержимого, чтобы следующий запуск
+            // по неизменённому дереву сразу попадал в кэш.
+            if (TU.Edits.empty() || llvm::any_of(TU.Edits, [&](const Replacement &R)
+                                                 { return R.getFilePath() != MainPath; }))
+                continue;
+            Replacements Replaces;
+            for (const auto &Edit : TU.Edits)
+                if (auto Err = Replaces.add(Edit))
+                {
+                    llvm::consumeError(std::move(Err));
+                    Replaces = Replacements();
+                    break;
+                }
+            if (Replaces.empty())
+                continue;
+            if (auto NewContent = applyAllReplacements(MainContent, Replaces))
+                Cache->store(ResultCache::computeKey(Commands, *NewContent, Fingerprint),
+                             TU.Dependencies, {}, MainPath, *NewContent);
+            else
+                llvm::consumeError(NewContent.takeError());
+        }
+    };
+
+    if (Jobs == 1)
+        Worker(Workers.front());
+    else
+    {
+        std::vector<std::thread> Threads;
+        Threads.reserve(Jobs);
+        for (unsigned I = 0; I < Jobs; ++I)
+            Threads.emplace_back(Worker, std::ref(Workers[I]));
+        for (auto &T : Threads)
+            T.join();
+    }
+
+    if (Options.EmitHierarchyDir.empty() && Export && Options.ExportUnmerged)
+    {
+        auto Edits = Collector.unique();
+        if (auto Err = exportFixes(Options.ExportFixes, Edits))
+        {
+            llvm::errs() << "Cannot export fixes: " << llvm::toString(std::move(Err)) << "\n";
+            Result = 1;
+        }
+        llvm::errs() << "Exported " << Edits.size() << " unmerged edits\n";
+    }
+    else if (Options.EmitHierarchyDir.empty())
+    {
+        auto Merged = Collector.merge();
+        Duplicates = Merged.Duplicates;
+        Conflicts = Merged.Conflicts.size();
+        reportConflicts(Merged, llvm::errs());
+
+        if (Export)
+        {
+            if (auto Err = exportFixes(Options.ExportFixes, Merged.Edits))
+            {
+                llvm::errs() << "Cannot export fixes: " << llvm::toString(std::move(Err)) << "\n";
+                Result = 1;
+            }
+            llvm::errs() << "Exported " << Merged.Edits.size() << " edits (" << Merged.Duplicates
+                         << " duplicates, " << Merged.Conflicts.size() << " conflicts)\n";
+        }
+        else if (!applyEdits(Merged.Edits, Writer))
+            Result = 1;
+    }
+
+    if (!Options.ProfileRanking.empty())
+        if (auto Err = Refactor.Ranking->write(Options.ProfileRanking))
+        {
+            llvm::errs() << "Cannot write profile ranking: " << llvm::toString(std::move(Err)) << "\n";
+            Result = 1;
+        }
+
+    if (Timings)
+        if (auto Err = Timings->save(Options.TimingsFile))
+        {
+            llvm::errs() << "Cannot write timings: " << llvm::toString(std::move(Err)) << "\n";
+            Result = 1;
+        }
+
+    if (Graph)
+        if (auto Err = Graph->save(Options.IncludeGraphPath))
+        {
+            llvm::errs() << "Cannot write include graph: " << llvm::toString(std::move(Err)) << "\n";
+            Result = 1;
+        }
+
+    if (!Options.ProfileReport.empty())
+    {
+        std::vector<TUProfile> Parsed;
+        llvm::copy_if(Profiles, std::back_inserter(Parsed), [](const TUProfile &P)
+                      { return P.Status == "parsed"; });
+        if (auto Err = writeProfileReport(Options.ProfileReport, std::move(Parsed)))
+        {
+            llvm::errs() << "Cannot write profile: " << llvm::toString(std::move(Err)) << "\n";
+            Result = 1;
+        }
+    }
+    if (Stats)
+    {
+        if (auto Err = writeStatsReport(Options.StatsReport, std::move(Profiles), Duplicates, Conflicts))
+        {
+            llvm::errs() << "Cannot write stats: " << llvm::toString(std::move(Err)) << "\n";
+            Result = 1;
+        }
+        else if (Journal)
+            Journal->remove();
+    }
+
+    if (Prefilter && Prefilter->enabled())
+        llvm::errs() << "Prefilter: skipped " << Prefiltered << " of " << Files.size() << " TUs\n";
+    if (Cache)
+        llvm::errs() << "Result cache: " << Cache->hits() << " hits, " << Cache->misses() << " misses\n";
+    if (Preambles)
+        llvm::errs() << llvm::format("Preamble cache: %u built (%.2fs), %u reused, %u rejected; ~%.2fs of preamble parsing saved\n",
+                                     Preambles->built(), Preambles->buildSeconds(), Preambles->reused(),
+                                     Preambles->failed(), Preambles->savedSeconds());
+
+    return Result;
+}
+
+int runRefactor(const CompilationDatabase &Compilations,
+                llvm::ArrayRef<std::string> SourcePaths,
+                const RunOptions &Options)
+{
+    return RefactorSession(Compilations, Options).run(SourcePaths);
+}
@@ -0,0 +1,236 @@
+#include "RefactorServer.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/raw_socket_stream.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+
+using namespace clang::tooling;
+
+namespace
+{
+    std::string absolutePath(llvm::StringRef Path)
+    {
+        llvm::SmallString<256> Abs(Path);
+        llvm::sys::fs::make_absolute(Abs);
+        llvm::sys::path::remove_dots(Abs, /*remove_dot_dot=*/true);
+        return std::string(Abs);
+    }
+
+    // Читает одну строку протокола (без '\n'). С неотрицательным Timeout строка должна прийти
+    // целиком за это время, иначе nullopt. Без таймаута ждёт, пока собеседник не закроет соединение.
+    std::optional<std::string> readLine(llvm::raw_socket_stream &Stream,
+                                        std::chrono::milliseconds Timeout = std::chrono::milliseconds(-1))
+    {
+        auto Deadline = std::chrono::steady_clock::now() + Timeout;
+        std::string Line;
+        char Buf[4096];
+        while (true)
+        {
+            auto Left = Timeout;
+            if (Timeout.count() >= 0)
+            {
+                Left = std::chrono::duration_cast<std::chrono::milliseconds>(Deadline - std::chrono::steady_clock::now());
+                if (Left.count() <= 0)
+                    return std::nullopt;
+            }
+            ssize_t Read = Stream.read(Buf, sizeof(Buf), Left);
+            if (Read < 0)
+            {
+                // Ошибку чтения сбрасываем, иначе деструктор потока сочтёт её необработанной.
+                bool TimedOut = Stream.error() == std::errc::timed_out;
+                Stream.clear_error();
+                if (TimedOut)
+                    return std::nullopt;
+                break;
+            }
+            if (Read == 0)
+                break;
+            Line.append(Buf, Read);
+            if (auto Pos = Line.find('\n'); Pos != std::string::npos)
+            {
+                Line.resize(Pos);
+                break;
+            }
+        }
+        return Line;
+    }
+
+    void writeLine(llvm::raw_socket_stream &Stream, const llvm::json::Value &Value)
+    {
+        Stream << Value << "\n";
+        Stream.flush();
+    }
+
+    std::optional<llvm::json::Value> exchange(llvm::StringRef SocketPath, llvm::json::Value Request)
+    {
+        auto Stream = llvm::raw_socket_stream::createConnectedUnix(SocketPath);
+        if (!Stream)
+        {
+            llvm::errs() << "Cannot connect to " << SocketPath << ": " << llvm::toString(Stream.takeError()) << "\n";
+            return std::nullopt;
+        }
+        writeLine(**Stream, Request);
+        auto Response = llvm::json::parse(readLine(**Stream).value_or(""));
+        if (!Response)
+        {
+            llvm::errs() << "Malformed server response: " << llvm::toString(Response.takeError()) << "\n";
+            return std::nullopt;
+        }
+        return std::move(*Response);
+    }
+
+    llvm::json::Value failure(llvm::StringRef Message)
+    {
+        return llvm::json::Object{{"status", 1}, {"error", Message}};
+    }
+} // namespace
+
+int serveRefactor(const CompilationDatabase &Compilations, const RunOptions &Options,
+                  llvm::StringRef SocketPath, llvm::ArrayRef<std::string> Warmup, bool Watch,
+                  unsigned WatchIntervalMs, unsigned ReadTimeoutMs)
+{
+    // Тёплые преамбулы - основная экономия сервера, поэтому кэш преамбул включён всегда.
+    RunOptions SessionOptions = Options;
+    if (SessionOptions.PreambleDir.empty())
+        SessionOptions.PreambleDir = (SocketPath + ".preambles").str();
+    RefactorSession Session(Compilations, SessionOptions);
+    std::mutex SessionMutex;
+    std::set<std::string> MainFiles; // под SessionMutex
+
+    // Файл сокета мог остаться от аварийно завершённого сервера; живой сервер не трогаем.
+    if (llvm::sys::fs::exists(SocketPath))
+    {
+        if (auto Probe = llvm::raw_socket_stream::createConnectedUnix(SocketPath))
+        {
+            llvm::errs() << "A server is already listening on " << SocketPath << "\n";
+            return 1;
+        }
+        else
+            llvm::consumeError(Probe.takeError());
+        llvm::sys::fs::remove(SocketPath);
+    }
+    auto Listener = llvm::ListeningSocket::createUnix(SocketPath);
+    if (!Listener)
+    {
+        llvm::errs() << "Cannot listen on " << SocketPath << ": " << llvm::toString(Listener.takeError()) << "\n";
+        return 1;
+    }
+
+    for (const auto &File : Warmup)
+    {
+        MainFiles.insert(absolutePath(File));
+        Session.warmPreamble(File);
+    }
+
+    std::mutex StopMutex;
+    std::condition_variable StopSignal;
+    bool Stop = false;
+    std::thread Watcher;
+    if (Watch)
+        Watcher = std::thread([&]()
+                              {
+                                  std::unique_lock<std::mutex> StopLock(StopMutex);
+                                  while (!StopSignal.wait_for(StopLock, std::chrono::milliseconds(WatchIntervalMs),
+                                                              [&] { return Stop; }))
+                                  {
+                                      std::lock_guard<std::mutex> Lock(SessionMutex);
+                                      for (const auto &File : Session.refresh())
+                                          if (MainFiles.count(File))
+                                              Session.warmPreamble(File);
+                                  } });
+
+    llvm::errs() << "Listening on " << SocketPath << "\n";
+    while (true)
+    {
+        auto Connection = Listener->accept();
+        if (!Connection)
+        {
+            llvm::errs() << "Accept failed: " << llvm::toString(Connection.takeError()) << "\n";
+            continue;
+        }
+
+        // Запросы обрабатываются по одному: клиент, не дописавший строку (например, упавший
+        // плагин редактора), не должен держать сервер, в том числе и запрос shutdown.
+        auto Line = readLine(**Connection, std::chrono::milliseconds(ReadTimeoutMs));
+        if (!Line)
+        {
+            llvm::errs() << "Request not received within " << ReadTimeoutMs << " ms, closing connection\n";
+            continue;
+        }
+        auto Request = llvm::json::parse(*Line);
+        if (!Request)
+        {
+            writeLine(**Connection, failure(llvm::toString(Request.takeError())));
+            continue;
+        }
+        const auto *Object = Request->getAsObject();
+        if (Object && Object->getString("command") == "shutdown")
+        {
+            writeLine(**Connection, llvm::json::Object{{"status", 0}});
+            break;
+        }
+        const auto *Paths = Object ? Object->getArray("files") : nullptr;
+        if (!Paths)
+        {
+            writeLine(**Connection, failure("expected {\"files\": [...]} or {\"command\": \"shutdown\"}"));
+            continue;
+        }
+
+        std::vector<std::string> Files;
+        for (const auto &Path : *Paths)
+            if (auto S = Path.getAsString())
+                Files.push_back(absolutePath(*S));
+
+        auto Start = std::chrono::steady_clock::now();
+        int Status;
+        {
+            std::lock_guard<std::mutex> Lock(SessionMutex);
+            MainFiles.insert(Files.begin(), Files.end());
+            Status = Session.run(Files);
+        }
+        double Ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+        writeLine(**Connection, llvm::json::Object{{"status", Status},
+                                                   {"files", static_cast<int64_t>(Files.size())},
+                                                   {"milliseconds", Ms}});
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(StopMutex);
+        Stop = true;
+    }
+    StopSignal.notify_all();
+    if (Watcher.joinable())
+        Watcher.join();
+    Listener->shutdown();
+    return 0;
+}
+
+int requestRefactor(llvm::StringRef SocketPath, llvm::ArrayRef<std::string> Files)
+{
+    llvm::json::Array Paths;
+    for (const auto &File : Files)
+        Paths.push_back(absolutePath(File));
+    auto Response = exchange(SocketPath, llvm::json::Object{{"files", std::move(Paths)}});
+    if (!Response)
+        return 1;
+    llvm::outs() << *Response << "\n";
+    const auto *Object = Response->getAsObject();
+    return Object ? Object->getInteger("status").value_or(1) : 1;
+}
+
+int requestShutdown(llvm::StringRef SocketPath)
+{
+    auto Response = exchange(SocketPath, llvm::json::Object{{"command", "shutdown"}});
+    if (!Response || !Response->getAsObject())
+        return 1;
+    return Response->getAsObject()->getInteger("status").value_or(1);
+}
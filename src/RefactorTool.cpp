@@ -1,15 +1,23 @@
+#include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/ASTMatchers/ASTMatchers.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Tooling/Tooling.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Rewrite/Core/Rewriter.h"
-#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/xxhash.h"
 
-#include <unordered_set>
 #include <string>
+#include <cstdint>
 
 #include "RefactorTool.h"
+#include "RefactorCheck.h"
+#include "ChangesWriter.h"
+#include "HierarchySummary.h"
+#include "ProfileData.h"
 
 using namespace clang;
 using namespace clang::ast_matchers;
@@ -17,279 +25,288 @@ using namespace clang::tooling;
 
 namespace details
 {
-    std::optional<SourceLocation> GetOverrideInsertLoc(llvm::StringRef iStr, SourceRange SR)
+    // Путь в TU может быть относительным к каталогу компиляции,
+    // а не к текущему каталогу процесса - приводим его к абсолютному.
+    std::string GetAbsolutePath(FileManager &FM, llvm::StringRef Path)
     {
-        std::optional<SourceLocation> res;
-        auto pos = iStr.find(')');
-        if (pos == StringRef::npos)
-            return res;
-
-        std::optional<size_t> preCommentPos;
-        size_t offset = 0;
-        auto controlOffset = [&offset](size_t newOffset, bool comment = false)
-        {
-            if (newOffset != StringRef::npos)
-                offset += newOffset;
-            return newOffset;
-        };
-
-        for (auto tmpStr = iStr.substr(pos + 1); !tmpStr.empty();)
-        {
-            tmpStr = tmpStr.substr(controlOffset(tmpStr.find_first_not_of(" \t\r\n")));
-            if (tmpStr.empty() || tmpStr.front() == '{' || tmpStr.front() == '=' || tmpStr.front() == ';')
-                break;
-
-            if (tmpStr.front() == '/')
-            {
-                auto endP = tmpStr.find("*/");
-                if (endP != StringRef::npos)
-                    endP += 2;
-
-                preCommentPos = offset;
-                tmpStr = tmpStr.substr(controlOffset(endP, true));
-            }
-            else if (std::isalnum(tmpStr.front()))
-            {
-                preCommentPos = std::nullopt;
-                auto it = std::find_if_not(tmpStr.begin(), tmpStr.end(), [](auto c)
-                                           { return std::isalpha(c); });
-                auto word = tmpStr.substr(0, it - tmpStr.begin());
-                std::optional<size_t> bracketOffset;
-                if ((word == "noexcept" || word == "throw") && (tmpStr[word.size()] == '('))
-                    if (auto pp = tmpStr.find(')', word.size()); pp != StringRef::npos)
-                        bracketOffset = pp + 1;
-                tmpStr = tmpStr.substr(controlOffset(bracketOffset.value_or(word.size())));
-            }
-            else if (tmpStr.front() == '&')
-            {
-                preCommentPos = std::nullopt;
-                size_t p = 1;
-                if (tmpStr.size() > 1 && tmpStr[1] == '&')
-                    p += 1;
-                tmpStr = tmpStr.substr(controlOffset(p));
-            }
-        }
-
-        auto begin = SR.getBegin();
-        res = begin.getLocWithOffset(static_cast<int>(pos + preCommentPos.value_or(offset)));
-
-        return res;
+        llvm::SmallString<256> Abs(Path);
+        FM.makeAbsolutePath(Abs);
+        llvm::sys::path::remove_dots(Abs, /*remove_dot_dot=*/true);
+        return std::string(Abs);
     }
 } // end namespace details
 
 static llvm::cl::OptionCategory ToolCategory("refactor-tool options");
 
-// Метод run вызывается для каждого совпадения с матчем.
-// Мы проверяем тип совпадения по bind-именам и применяем рефакторинг.
-void RefactorHandler::run(const MatchFinder::MatchResult &Result)
+bool RefactorOptions::isEnabled(llvm::StringRef Check) const
 {
-    DiagnosticsEngine &Diag = Result.Context->getDiagnostics();
-    SourceManager &SM = *Result.SourceManager;
-
-    // Невиртуальные деструкторы
-    if (const auto *Dtor = Result.Nodes.getNodeAs<CXXDestructorDecl>("nonVirtualDtor"))
-        handle_nv_dtor(Dtor, Diag, SM);
-
-    // Методы без override
-    if (const auto *Method = Result.Nodes.getNodeAs<CXXMethodDecl>("missingOverride"))
-        if (Method->size_overridden_methods() > 0 && !Method->hasAttr<OverrideAttr>())
-            handle_miss_override(Method, Diag, SM);
-
-    // range-for без & (const T -> const T&)
-    if (const auto *LoopVar = Result.Nodes.getNodeAs<VarDecl>("loopVar"))
-        handle_crange_for(LoopVar, Diag, SM);
+    if (!Checks.empty())
+        return llvm::is_contained(Checks, Check);
+    const auto *Info = llvm::find_if(registeredChecks(), [&](const CheckInfo &Entry)
+                                     { return Entry.Name == Check; });
+    return Info == registeredChecks().end() || !Info->OptIn;
 }
 
-// Обработка невиртуального деструктора: добавляем 'virtual ' перед '~' если есть наследники.
-void RefactorHandler::handle_nv_dtor(const CXXDestructorDecl *Dtor,
-                                     DiagnosticsEngine &Diag,
-                                     SourceManager &SM)
+uint64_t RefactorOptions::fingerprint() const
 {
-    if (!Dtor)
-        return;
+    // Набор проверок учитывается по реестру: пустой список и явный список всех проверок равны.
+    std::string Enabled;
+    for (const auto &Info : registeredChecks())
+        if (isEnabled(Info.Name))
+            Enabled += (Info.Name + ",").str();
+
+    uint64_t Parts[8] = {Hierarchy ? Hierarchy->fingerprint() : 0,
+                         llvm::xxh3_64bits(llvm::arrayRefFromStringRef(HeaderFilter)),
+                         llvm::xxh3_64bits(llvm::arrayRefFromStringRef(Enabled)),
+                         LimitTraversal,
+                         ProfileData ? ProfileData->fingerprint() : 0,
+                         ProfileThreshold,
+                         SkipInstantiations,
+                         CopyThreshold};
+    return llvm::xxh3_64bits(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(Parts), sizeof(Parts)));
+}
 
-    auto loc = Dtor->getLocation();
-    if (loc.isInvalid() || !SM.isInMainFile(loc) || SM.isInSystemHeader(loc))
-        return;
+bool HeaderClaims::claimed(StringRef Path)
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    return Claimed.contains(Path);
+}
 
-    if (Dtor->isVirtual())
-        return;
+void HeaderClaims::commit(llvm::ArrayRef<std::string> Paths)
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    for (const auto &Path : Paths)
+        Claimed.insert(Path);
+}
 
-    const auto *Parent = Dtor->getParent();
-    if (!Parent)
-        return;
-    if (!Parent->hasDefinition())
-        return;
+RefactorHandler::RefactorHandler(Rewriter &Rewrite, const RefactorOptions &Options,
+                                 std::vector<Replacement> &Edits, TUProfile *Profile, TUResult *Result)
+    : Rewrite(Rewrite), Options(Options), Edits(Edits), Profile(Profile), Result(Result)
+{
+    if (!Options.HeaderFilter.empty())
+        HeaderFilter.emplace(Options.HeaderFilter);
+}
 
-    // Найдём, есть ли производные классы в TU
-    auto &Ctx = Parent->getASTContext();
-    bool hasDerived = false;
-    for (auto *D : Ctx.getTranslationUnitDecl()->decls())
+bool RefactorHandler::canRewrite(SourceManager &SM, SourceLocation Loc, bool ContextFree)
+{
+    if (Loc.isInvalid())
+        return skip("invalid_location");
+    if (SM.isInSystemHeader(Loc))
+        return skip("system_header");
+    if (SM.isInMainFile(Loc))
+        return true;
+    if (!HeaderFilter)
+        return skip("not_main_file");
+
+    auto FID = SM.getFileID(SM.getExpansionLoc(Loc));
+    if (!matchesHeaderFilter(SM, FID))
+        return skip("header_filtered_out");
+    if (!ContextFree || !Options.Claims)
+        return true;
+
+    // Правку, не зависящую от TU, вычисляет только первая успешно разобранная TU, включившая
+    // заголовок. Занятым он станет, когда вызывающий примет результат этой TU: если она
+    // не скомпилируется, правки вычислит следующая.
+    auto [Owned, First] = OwnedHeaders.try_emplace(FID, false);
+    if (First)
     {
-        if (const auto *RD = dyn_cast<CXXRecordDecl>(D))
-        {
-            if (!RD->hasDefinition())
-                continue;
-            for (const auto &Base : RD->bases())
-            {
-                if (const auto *T = Base.getType().getTypePtrOrNull())
-                {
-                    if (const auto *RT = T->getAs<RecordType>())
-                    {
-                        if (const auto *BaseDecl = dyn_cast<CXXRecordDecl>(RT->getDecl()))
-                        {
-                            if (BaseDecl->getCanonicalDecl() == Parent->getCanonicalDecl())
-                            {
-                                hasDerived = true;
-                                break;
-                            }
-                        }
-                    }
-                }
-            }
-            if (hasDerived)
-                break;
-        }
+        auto Entry = SM.getFileEntryRefForID(FID);
+        auto Path = Entry ? details::GetAbsolutePath(SM.getFileManager(), Entry->getName()) : std::string();
+        Owned->second = Entry && !Options.Claims->claimed(Path);
+        if (Owned->second && Result)
+            Result->ClaimedHeaders.push_back(Path);
+        else if (Owned->second)
+            Options.Claims->commit(Path);
     }
-    if (!hasDerived)
-        return;
-
-    unsigned raw = loc.getRawEncoding();
-    if (virtualDtorLocations.count(raw))
-        return; // уже обработано
-
-    Rewrite.InsertTextBefore(loc, "virtual ");
-    virtualDtorLocations.insert(raw);
-
-    unsigned DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Добавлен 'virtual' к деструктору");
-    Diag.Report(loc, DiagID);
+    return Owned->second || skip("header_owned_by_other_tu");
 }
 
-// Обработка методов без override: вставляем ' override' после закрывающей ')'
-void RefactorHandler::handle_miss_override(const CXXMethodDecl *Method,
-                                           DiagnosticsEngine &Diag,
-                                           SourceManager &SM)
+void RefactorHandler::rank(RankedEdit Edit)
 {
-    if (!Method)
-        return;
-
-    auto loc = Method->getLocation();
-    if (loc.isInvalid() || !SM.isInMainFile(loc) || SM.isInSystemHeader(loc))
-        return;
-
-    // Метод должен переопределять базовый
-    if (Method->size_overridden_methods() == 0 || Method->hasAttr<OverrideAttr>() || Method->hasAttr<FinalAttr>())
-        return;
-
-    auto SR = Method->getSourceRange();
-    auto CSR = CharSourceRange::getTokenRange(SR);
-    auto &Ctx = Method->getASTContext();
-    const auto &LangOpts = Ctx.getLangOpts();
-
-    auto insertLoc = details::GetOverrideInsertLoc(Lexer::getSourceText(CSR, SM, LangOpts), SR);
-    if (!insertLoc || insertLoc->isInvalid() || !SM.isInMainFile(*insertLoc))
-        return;
-
-    auto raw = insertLoc->getRawEncoding();
-    if (virtualDtorLocations.count(raw))
-        return; // уже изменяли тут
-
-    Rewrite.InsertTextBefore(*insertLoc, " override");
-    virtualDtorLocations.insert(raw);
-
-    auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Добавлен 'override' к методу");
-    Diag.Report(*insertLoc, DiagID);
+    if (Result)
+        Result->Ranked.push_back(std::move(Edit));
+    else if (Options.Ranking)
+        Options.Ranking->add(std::move(Edit));
 }
 
-// Обработка range-for: добавляем '&' после типа, если это const T (не ссылка и не фундаментальный)
-void RefactorHandler::handle_crange_for(const VarDecl *LoopVar,
-                                        DiagnosticsEngine &Diag,
-                                        SourceManager &SM)
+bool RefactorHandler::isEditableFile(SourceManager &SM, SourceLocation Loc)
 {
-    if (!LoopVar)
-        return;
-
-    auto loc = LoopVar->getLocation();
-    if (loc.isInvalid() || !SM.isInMainFile(loc) || SM.isInSystemHeader(loc))
-        return;
+    if (Loc.isInvalid() || SM.isInSystemHeader(Loc))
+        return false;
+    if (SM.isInMainFile(Loc))
+        return true;
+    return HeaderFilter && matchesHeaderFilter(SM, SM.getFileID(SM.getExpansionLoc(Loc)));
+}
 
-    auto &Ctx = LoopVar->getASTContext();
-    const auto &LangOpts = Ctx.getLangOpts();
+bool RefactorHandler::matchesHeaderFilter(SourceManager &SM, FileID FID)
+{
+    auto [It, Inserted] = AllowedFiles.try_emplace(FID, false);
+    if (Inserted)
+    {
+        if (auto Entry = SM.getFileEntryRefForID(FID))
+            It->second = HeaderFilter->match(details::GetAbsolutePath(SM.getFileManager(), Entry->getName()));
+    }
+    return It->second;
+}
 
-    auto QT = LoopVar->getType();
-    if (QT.isNull())
-        return;
-    if (QT->isReferenceType())
-        return; // уже ссылка
-    if (QT->isPointerType())
-        return; // не трогаем указатели
-    if (QT->isFundamentalType())
-        return; // не трогаем примитивы
-
-    if (!LoopVar->getTypeSourceInfo())
-        return;
-    auto TL = LoopVar->getTypeSourceInfo()->getTypeLoc();
-    auto endLoc = TL.getEndLoc();
-    if (endLoc.isInvalid())
-        return;
+// Единая точка всех правок: вставка через Rewriter, защита от повторной вставки
+// в то же место (по файлу и смещению) и запись правки в список Edits.
+bool RefactorHandler::insertText(SourceManager &SM, SourceLocation Loc, StringRef Text)
+{
+    if (Loc.isInvalid())
+        return skip("invalid_location");
+    if (!Loc.isFileID())
+        return skip("macro"); // место внутри макроса переписать нельзя
+
+    Replacement Edit(SM, Loc, 0, Text);
+    if (!EditedLocations.emplace(Edit.getFilePath().str(), Edit.getOffset()).second)
+        return skip("duplicate_location");
+    if (Rewrite.InsertTextBefore(Loc, Text))
+        return skip("rewriter_failed");
+
+    Edits.push_back(std::move(Edit));
+    if (Profile)
+        ++Profile->EditsApplied;
+    return true;
+}
 
-    auto insertLoc = Lexer::getLocForEndOfToken(endLoc, 0, SM, LangOpts);
-    if (insertLoc.isInvalid() || !SM.isInMainFile(insertLoc))
-        return;
+bool RefactorHandler::skip(llvm::StringRef Reason)
+{
+    if (Profile)
+        ++Profile->EditsSkipped[Reason.str()];
+    return false;
+}
 
-    auto raw = insertLoc.getRawEncoding();
-    if (virtualDtorLocations.count(raw))
-        return;
+namespace
+{
+    // Считает узлы, которые обходит MatchFinder: с неявным кодом и инстанцированиями шаблонов.
+    class NodeCounter : public RecursiveASTVisitor<NodeCounter>
+    {
+    public:
+        bool shouldVisitTemplateInstantiations() const { return true; }
+        bool shouldVisitImplicitCode() const { return true; }
+        bool VisitDecl(Decl *)
+        {
+            ++Decls;
+            return true;
+        }
+        bool VisitStmt(Stmt *)
+        {
+            ++Stmts;
+            return true;
+        }
 
-    Rewrite.InsertTextBefore(insertLoc, "&");
-    virtualDtorLocations.insert(raw);
+        uint64_t Decls = 0;
+        uint64_t Stmts = 0;
+    };
+} // namespace
 
-    auto DiagID = Diag.getCustomDiagID(DiagnosticsEngine::Remark, "Добавлен '&' в range-for переменной");
-    Diag.Report(insertLoc, DiagID);
+static MatchFinder::MatchFinderOptions finderOptions(TUProfile *Profile, llvm::StringMap<llvm::TimeRecord> &Times)
+{
+    MatchFinder::MatchFinderOptions FinderOptions;
+    if (Profile)
+        FinderOptions.CheckProfiling.emplace(Times);
+    return FinderOptions;
 }
 
-auto NvDtorMatcher()
+ComplexConsumer::ComplexConsumer(Rewriter &Rewrite, std::vector<Replacement> &Edits, RefactorOptions Options,
+                                 TUProfile *Profile, TUResult *Result)
+    : Options(Options), Profile(Profile), Created(std::chrono::steady_clock::now()),
+      CreatedCpu(Profile ? threadCpuSeconds() : 0),
+      Handler(Rewrite, this->Options, Edits, Profile, Result),
+      Finder(finderOptions(Profile, MatcherTimes))
 {
-    return cxxDestructorDecl(unless(isVirtual()), unless(isImplicit())).bind("nonVirtualDtor");
+    // Создаются только включённые проверки: состояние остальных не выделяется,
+    // а их матчеры не примеряются к каждому узлу AST.
+    for (const auto &Info : registeredChecks())
+        if (this->Options.isEnabled(Info.Name))
+        {
+            Checks.push_back(Info.Create(Handler));
+            Checks.back()->registerMatchers(Finder);
+        }
 }
 
-auto NoOverrideMatcher()
+bool ComplexConsumer::HandleTopLevelDecl(DeclGroupRef Group)
 {
-    return cxxMethodDecl(
-               isOverride(),
-               unless(cxxDestructorDecl()) // исключаем деструкторы
-               )
-        .bind("missingOverride");
+    if (Options.LimitTraversal)
+        TopLevelDecls.insert(TopLevelDecls.end(), Group.begin(), Group.end());
+    return true;
 }
 
-auto NoRefConstVarInRangeLoopMatcher()
+void ComplexConsumer::limitTraversal(ASTContext &Context)
 {
-    return cxxForRangeStmt(
-        hasLoopVariable(
-            varDecl(
-                hasType(qualType(
-                    isConstQualified(),
-                    unless(referenceType()))))
-                .bind("loopVar")));
+    // Объявления из PCH преамбулы не проходят через HandleTopLevelDecl. Это только заголовки:
+    // без --header-filter они не правятся, а с ним пришлось бы обходить всё.
+    if (!Options.HeaderFilter.empty() && Context.getExternalSource())
+        return;
+
+    // Объявление берётся, если правимому файлу принадлежит его начало, имя или конец:
+    // так не теряется и пространство имён, открытое макросом из заголовка.
+    auto &SM = Context.getSourceManager();
+    std::vector<Decl *> Scope;
+    for (auto *D : TopLevelDecls)
+        if (Handler.isEditableFile(SM, D->getLocation()) || Handler.isEditableFile(SM, D->getBeginLoc()) ||
+            Handler.isEditableFile(SM, D->getEndLoc()))
+            Scope.push_back(D);
+    Context.setTraversalScope(Scope);
 }
 
-ComplexConsumer::ComplexConsumer(Rewriter &Rewrite) : Handler(Rewrite)
+void ComplexConsumer::match(ASTContext &Context)
 {
-    Finder.addMatcher(NvDtorMatcher(), &Handler);
-    Finder.addMatcher(NoOverrideMatcher(), &Handler);
-    Finder.addMatcher(NoRefConstVarInRangeLoopMatcher(), &Handler);
+    {
+        std::optional<ScopedTimer> Timer;
+        if (Profile)
+            Timer.emplace(Profile->Match);
+        Finder.matchAST(Context);
+    }
+
+    // Отдельный обход вне замеров фаз, только для --stats. Считаются узлы той же области обхода.
+    if (Profile && Options.CountNodes)
+    {
+        NodeCounter Counter;
+        Counter.TraverseAST(Context);
+        Profile->Decls += Counter.Decls;
+        Profile->Stmts += Counter.Stmts;
+    }
 }
 
 void ComplexConsumer::HandleTranslationUnit(ASTContext &Context)
 {
-    Finder.matchAST(Context);
+    if (Checks.empty())
+        return;
+
+    if (Profile)
+    {
+        // Консьюмер создаётся перед разбором, а сюда попадаем с готовым AST.
+        Profile->Parse.Wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - Created).count();
+        Profile->Parse.Cpu += threadCpuSeconds() - CreatedCpu;
+    }
+    {
+        // prepare обходит всю TU (индекс наследников должен видеть классы из заголовков),
+        // поэтому выполняется до ограничения области обхода.
+        std::optional<ScopedTimer> Timer;
+        if (Profile)
+            Timer.emplace(Profile->Prepare);
+        for (auto &Check : Checks)
+            Check->prepare(Context);
+        if (Options.LimitTraversal)
+            limitTraversal(Context);
+    }
+    match(Context);
+    if (Options.LimitTraversal)
+        Context.setTraversalScope({Context.getTranslationUnitDecl()});
+
+    if (Profile)
+        for (const auto &Entry : MatcherTimes)
+            Profile->Matchers[Entry.first().str()] += Entry.second.getWallTime();
 }
 
 std::unique_ptr<ASTConsumer> CodeRefactorAction::CreateASTConsumer(CompilerInstance &CI,
                                                                    StringRef file)
 {
     RewriterForCodeRefactor.setSourceMgr(CI.getSourceManager(), CI.getLangOpts());
-    return std::make_unique<ComplexConsumer>(RewriterForCodeRefactor);
+    return std::make_unique<ComplexConsumer>(RewriterForCodeRefactor, Edits, Options,
+                                             Options.Profile && Result ? &Result->Profile : nullptr, Result);
 }
 
 bool CodeRefactorAction::BeginSourceFileAction(CompilerInstance &CI)
@@ -300,6 +317,48 @@ bool CodeRefactorAction::BeginSourceFileAction(CompilerInstance &CI)
 
 void CodeRefactorAction::EndSourceFileAction()
 {
-    if (RewriterForCodeRefactor.overwriteChangedFiles())
-        llvm::errs() << "Error applying changes to files.\n";
+    auto &SM = RewriterForCodeRefactor.getSourceMgr();
+    auto &FM = SM.getFileManager();
+
+    std::optional<ScopedTimer> FlushTimer;
+    if (Result && Options.Profile)
+        FlushTimer.emplace(Result->Profile.Flush);
+
+    if (Result)
+    {
+        if (Options.Profile)
+            Result->Profile.PeakRSS = peakRSSBytes();
+        for (const auto &Edit : Edits)
+            Result->Edits.emplace_back(details::GetAbsolutePath(FM, Edit.getFilePath()), Edit.getOffset(),
+                                       Edit.getLength(), Edit.getReplacementText());
+        for (auto It = SM.fileinfo_begin(); It != SM.fileinfo_end(); ++It)
+            Result->Dependencies.push_back(details::GetAbsolutePath(FM, It->first.getName()));
+    }
+
+    if (!Writer)
+    {
+        if (Result)
+            return; // только сбор правок, файлы не трогаем
+        if (RewriterForCodeRefactor.overwriteChangedFiles())
+            llvm::errs() << "Error applying changes to files.\n";
+        return;
+    }
+
+    for (auto It = RewriterForCodeRefactor.buffer_begin(); It != RewriterForCodeRefactor.buffer_end(); ++It)
+    {
+        auto Entry = SM.getFileEntryRefForID(It->first);
+        if (!Entry)
+            continue;
+
+        std::string Content;
+        llvm::raw_string_ostream OS(Content);
+        It->second.write(OS);
+        OS.flush();
+        Writer->submit(details::GetAbsolutePath(FM, Entry->getName()), Content);
+    }
+}
+
+std::unique_ptr<FrontendAction> CodeRefactorActionFactory::create()
+{
+    return std::make_unique<CodeRefactorAction>(Writer, Options, Result);
 }
\ No newline at end of file
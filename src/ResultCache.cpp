@@ -0,0 +1,199 @@
+#include "ResultCache.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/BLAKE3.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang::tooling;
+
+namespace
+{
+    // Меняется при изменении формата записи или логики проверок.
+    constexpr llvm::StringLiteral CacheVersion = "refactor-tool-cache-v2";
+
+    std::string hashContent(llvm::StringRef Content)
+    {
+        return llvm::toHex(llvm::BLAKE3::hash<16>(llvm::arrayRefFromStringRef(Content)), /*LowerCase=*/true);
+    }
+
+    // Описание зависимости: размер и время изменения позволяют не перечитывать
+    // неизменённые файлы, хэш содержимого - не доверять одному mtime.
+    struct Dependency
+    {
+        std::string Path;
+        uint64_t Size = 0;
+        int64_t MTime = 0;
+        std::string Hash;
+    };
+
+    std::optional<Dependency> describe(llvm::StringRef Path)
+    {
+        llvm::sys::fs::file_status Status;
+        if (llvm::sys::fs::status(Path, Status))
+            return std::nullopt;
+        auto Buf = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+        if (!Buf)
+            return std::nullopt;
+
+        Dependency Dep;
+        Dep.Path = Path.str();
+        Dep.Size = Status.getSize();
+        Dep.MTime = Status.getLastModificationTime().time_since_epoch().count();
+        Dep.Hash = hashContent((*Buf)->getBuffer());
+        return Dep;
+    }
+
+    bool isUpToDate(const Dependency &Dep)
+    {
+        llvm::sys::fs::file_status Status;
+        if (llvm::sys::fs::status(Dep.Path, Status))
+            return false;
+        if (Status.getSize() != Dep.Size)
+            return false;
+        if (Status.getLastModificationTime().time_since_epoch().count() == Dep.MTime)
+            return true;
+
+        // mtime изменился - сверяем содержимое (например, после git checkout того же состояния).
+        auto Current = describe(Dep.Path);
+        return Current && Current->Hash == Dep.Hash;
+    }
+} // namespace
+
+ResultCache::ResultCache(std::string Dir) : Dir(std::move(Dir))
+{
+    llvm::sys::fs::create_directories(this->Dir);
+}
+
+std::string ResultCache::computeKey(llvm::ArrayRef<CompileCommand> Commands,
+                                    llvm::StringRef MainFileContent,
+                                    uint64_t OptionsFingerprint)
+{
+    llvm::BLAKE3 Hasher;
+    auto add = [&](llvm::StringRef S)
+    {
+        Hasher.update(S);
+        Hasher.update(llvm::StringRef("\0", 1));
+    };
+
+    add(CacheVersion);
+    add(llvm::utohexstr(OptionsFingerprint));
+    for (const auto &Command : Commands)
+    {
+        add(Command.Directory);
+        add(Command.Filename);
+        for (const auto &Arg : Command.CommandLine)
+            add(Arg);
+    }
+    add(MainFileContent);
+    return llvm::toHex(Hasher.final<16>(), /*LowerCase=*/true);
+}
+
+std::string ResultCache::entryPath(llvm::StringRef Key) const
+{
+    llvm::SmallString<256> Path(Dir);
+    llvm::sys::path::append(Path, Key + ".json");
+    return std::string(Path);
+}
+
+std::optional<std::vector<Replacement>> ResultCache::lookup(llvm::StringRef Key)
+{
+    auto miss = [this]() -> std::optional<std::vector<Replacement>>
+    {
+        ++Misses;
+        return std::nullopt;
+    };
+
+    auto Buf = llvm::MemoryBuffer::getFile(entryPath(Key));
+    if (!Buf)
+        return miss();
+    auto Parsed = llvm::json::parse((*Buf)->getBuffer());
+    if (!Parsed)
+    {
+        llvm::consumeError(Parsed.takeError());
+        return miss();
+    }
+
+    const auto *Root = Parsed->getAsObject();
+    const auto *Deps = Root ? Root->getArray("deps") : nullptr;
+    const auto *Edits = Root ? Root->getArray("edits") : nullptr;
+    if (!Deps || !Edits)
+        return miss();
+
+    for (const auto &Value : *Deps)
+    {
+        const auto *Obj = Value.getAsObject();
+        if (!Obj)
+            return miss();
+        Dependency Dep;
+        Dep.Path = Obj->getString("path").value_or("").str();
+        Dep.Size = Obj->getInteger("size").value_or(-1);
+        Dep.MTime = Obj->getInteger("mtime").value_or(0);
+        Dep.Hash = Obj->getString("hash").value_or("").str();
+        if (!isUpToDate(Dep))
+            return miss();
+    }
+
+    std::vector<Replacement> Result;
+    for (const auto &Value : *Edits)
+    {
+        const auto *Obj = Value.getAsObject();
+        if (!Obj)
+            return miss();
+        auto File = Obj->getString("file");
+        auto Offset = Obj->getInteger("offset");
+        auto Length = Obj->getInteger("length");
+        auto Text = Obj->getString("text");
+        if (!File || !Offset || !Length || !Text)
+            return miss();
+        Result.emplace_back(*File, *Offset, *Length, *Text);
+    }
+
+    ++Hits;
+    return Result;
+}
+
+void ResultCache::store(llvm::StringRef Key, llvm::ArrayRef<std::string> Dependencies,
+                        llvm::ArrayRef<Replacement> Edits,
+                        llvm::StringRef MainFile, llvm::StringRef MainFileContent)
+{
+    llvm::json::Array Deps;
+    for (const auto &Path : Dependencies)
+    {
+        Dependency Dep;
+        if (!MainFile.empty() && Path == MainFile)
+        {
+            // Содержимое главного файла известно заранее (например, до записи правок на диск):
+            // mtime не сохраняем, чтобы при проверке сравнивался хэш.
+            Dep.Path = Path;
+            Dep.Size = MainFileContent.size();
+            Dep.Hash = hashContent(MainFileContent);
+        }
+        else if (auto Described = describe(Path))
+            Dep = std::move(*Described);
+        else
+            return; // файл пропал - такой результат сохранять нельзя
+
+        Deps.push_back(llvm::json::Object{{"path", Dep.Path},
+                                          {"size", static_cast<int64_t>(Dep.Size)},
+                                          {"mtime", Dep.MTime},
+                                          {"hash", Dep.Hash}});
+    }
+
+    llvm::json::Array EditsJson;
+    for (const auto &Edit : Edits)
+        EditsJson.push_back(llvm::json::Object{{"file", Edit.getFilePath()},
+                                               {"offset", static_cast<int64_t>(Edit.getOffset())},
+                                               {"length", static_cast<int64_t>(Edit.getLength())},
+                                               {"text", Edit.getReplacementText()}});
+
+    llvm::json::Value Entry = llvm::json::Object{{"deps", std::move(Deps)}, {"edits", std::move(EditsJson)}};
+    if (auto Err = llvm::writeToOutput(entryPath(Key), [&](llvm::raw_ostream &OS)
+                                       {
+                                           OS << Entry;
+                                           return llvm::Error::success(); }))
+        llvm::errs() << "Cannot write cache entry: " << llvm::toString(std::move(Err)) << "\n";
+}
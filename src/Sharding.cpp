@@ -0,0 +1,95 @@
+#include "Sharding.h"
+#include "EditCollector.h"
+#include "ChangesWriter.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+
+llvm::Expected<ShardSpec> parseShardSpec(llvm::StringRef Spec)
+{
+    auto [IndexText, CountText] = Spec.split('/');
+    ShardSpec Shard;
+    if (IndexText.getAsInteger(10, Shard.Index) || CountText.getAsInteger(10, Shard.Count) || Shard.Count == 0 ||
+        Shard.Index >= Shard.Count)
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "expected i/N with 0 <= i < N, got '" + Spec.str() + "'");
+    return Shard;
+}
+
+std::vector<std::string> selectShard(llvm::ArrayRef<std::string> Files, ShardSpec Shard)
+{
+    struct Item
+    {
+        uint64_t Size;
+        llvm::StringRef Path;
+    };
+    std::vector<Item> Items;
+    for (const auto &File : Files)
+    {
+        uint64_t Size = 0;
+        if (llvm::sys::fs::file_size(File, Size))
+            Size = 0; // недоступный файл всё равно достаётся ровно одному шарду
+        Items.push_back({Size, File});
+    }
+    // Самые тяжёлые TU распределяются первыми (LPT); при равном размере - по пути,
+    // чтобы порядок аргументов не влиял на распределение.
+    llvm::sort(Items, [](const Item &L, const Item &R)
+               { return std::tie(R.Size, L.Path) < std::tie(L.Size, R.Path); });
+    Items.erase(std::unique(Items.begin(), Items.end(), [](const Item &L, const Item &R)
+                            { return L.Path == R.Path; }),
+                Items.end());
+
+    std::vector<uint64_t> Load(Shard.Count, 0);
+    std::vector<std::string> Result;
+    for (const auto &It : Items)
+    {
+        // Наименее загруженный шард; при равенстве - с меньшим номером.
+        auto Target = std::min_element(Load.begin(), Load.end()) - Load.begin();
+        // Пустые файлы тоже разбираются: учитываем их как минимальную нагрузку.
+        Load[Target] += std::max<uint64_t>(It.Size, 1);
+        if (static_cast<unsigned>(Target) == Shard.Index)
+            Result.push_back(It.Path.str());
+    }
+    llvm::sort(Result);
+    return Result;
+}
+
+int mergeShardFixes(llvm::ArrayRef<std::string> Inputs, llvm::StringRef Output, bool Apply)
+{
+    std::vector<clang::tooling::Replacement> All;
+    for (const auto &Input : Inputs)
+    {
+        auto Edits = importFixes(Input);
+        if (!Edits)
+        {
+            llvm::errs() << "Cannot read " << Input << ": " << llvm::toString(Edits.takeError()) << "\n";
+            return 1;
+        }
+        All.insert(All.end(), Edits->begin(), Edits->end());
+    }
+
+    auto Merged = mergeEdits(std::move(All));
+    reportConflicts(Merged, llvm::errs());
+    llvm::errs() << "Merged " << Inputs.size() << " shards: " << Merged.Edits.size() << " edits ("
+                 << Merged.Duplicates << " duplicates, " << Merged.Conflicts.size() << " conflicts)\n";
+
+    int Result = 0;
+    if (!Output.empty())
+        if (auto Err = exportFixes(Output, Merged.Edits))
+        {
+            llvm::errs() << "Cannot export fixes: " << llvm::toString(std::move(Err)) << "\n";
+            Result = 1;
+        }
+    if (Apply)
+    {
+        ChangesWriter Writer;
+        if (!applyEdits(Merged.Edits, Writer))
+            Result = 1;
+    }
+    return Result;
+}
@@ -0,0 +1,313 @@
+#include "TUProfile.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <ctime>
+#include <optional>
+#include <utility>
+
+#include <sys/resource.h>
+
+namespace
+{
+    // Пары (имя, секунды) по убыванию времени; при равенстве - по имени, чтобы отчёт был стабилен.
+    template <typename Map, typename CostFn>
+    std::vector<std::pair<std::string, typename Map::mapped_type>> byCost(const Map &Items, CostFn Cost)
+    {
+        // std::map уже упорядочен по имени, stable_sort сохраняет этот порядок для равных.
+        std::vector<std::pair<std::string, typename Map::mapped_type>> Sorted(Items.begin(), Items.end());
+        llvm::stable_sort(Sorted, [&](const auto &L, const auto &R)
+                          { return Cost(L.second) > Cost(R.second); });
+        return Sorted;
+    }
+
+    llvm::json::Array phases(const TUProfile &P)
+    {
+        std::map<std::string, double> Phases = {
+            {"parse", P.Parse.Wall}, {"prepare", P.Prepare.Wall}, {"match", P.Match.Wall}, {"flush", P.Flush.Wall}};
+        llvm::json::Array Result;
+        for (const auto &[Name, Seconds] : byCost(Phases, [](double S) { return S; }))
+            Result.push_back(llvm::json::Object{{"name", Name}, {"seconds", Seconds}});
+        return Result;
+    }
+
+    llvm::json::Array matchers(const TUProfile &P)
+    {
+        llvm::json::Array Result;
+        for (const auto &[Name, Seconds] : byCost(P.Matchers, [](double S) { return S; }))
+            Result.push_back(llvm::json::Object{{"name", Name}, {"seconds", Seconds}});
+        return Result;
+    }
+
+    llvm::json::Array handlers(const TUProfile &P)
+    {
+        llvm::json::Array Result;
+        for (const auto &[Name, Stats] : byCost(P.Handlers, [](const TUProfile::HandlerStats &S) { return S.Seconds; }))
+            Result.push_back(llvm::json::Object{{"name", Name}, {"seconds", Stats.Seconds}, {"calls", Stats.Calls}});
+        return Result;
+    }
+
+    void add(TUProfile::Phase &To, const TUProfile::Phase &From)
+    {
+        To.Wall += From.Wall;
+        To.Cpu += From.Cpu;
+    }
+
+    llvm::json::Object phaseTimes(const TUProfile &P)
+    {
+        llvm::json::Object Result;
+        for (auto [Name, Phase] : {std::pair{"parse", &P.Parse}, std::pair{"prepare", &P.Prepare},
+                                   std::pair{"match", &P.Match}, std::pair{"flush", &P.Flush}})
+            Result[Name] = llvm::json::Object{{"wall", Phase->Wall}, {"cpu", Phase->Cpu}};
+        return Result;
+    }
+
+    template <typename Map, typename ValueFn>
+    llvm::json::Object toObject(const Map &Items, ValueFn Value)
+    {
+        llvm::json::Object Result;
+        for (const auto &[Name, Item] : Items)
+            Result[Name] = Value(Item);
+        return Result;
+    }
+
+    // Общая часть записи TU и итогов в --stats.
+    llvm::json::Object stats(const TUProfile &P)
+    {
+        return llvm::json::Object{
+            {"phases", phaseTimes(P)},
+            {"wall", P.total()},
+            {"cpu", P.Parse.Cpu + P.Prepare.Cpu + P.Match.Cpu + P.Flush.Cpu},
+            {"peak_rss_bytes", static_cast<int64_t>(P.PeakRSS)},
+            {"peak_rss_growth_bytes", static_cast<int64_t>(P.PeakRSSGrowth)},
+            {"decls", static_cast<int64_t>(P.Decls)},
+            {"stmts", static_cast<int64_t>(P.Stmts)},
+            {"matches", toObject(P.Handlers, [](const TUProfile::HandlerStats &S) { return S.Calls; })},
+            {"edits", llvm::json::Object{{"applied", P.EditsApplied},
+                                         {"skipped", toObject(P.EditsSkipped, [](unsigned N) { return N; })}}}};
+    }
+
+    // Поле "<Key>: N kB" из /proc/self/status, в байтах. Вне Linux файла нет.
+    std::optional<uint64_t> procStatusBytes(llvm::StringRef Key)
+    {
+        // Файл в procfs имеет нулевой размер: читаем как поток.
+        auto Buf = llvm::MemoryBuffer::getFileAsStream("/proc/self/status");
+        if (!Buf)
+            return std::nullopt;
+        llvm::SmallVector<llvm::StringRef> Lines;
+        (*Buf)->getBuffer().split(Lines, '\n');
+        for (auto Line : Lines)
+        {
+            if (!Line.consume_front(Key) || !Line.consume_front(":"))
+                continue;
+            Line = Line.trim();
+            uint64_t KiB;
+            if (!Line.consume_back_insensitive("kB") || Line.trim().getAsInteger(10, KiB))
+                return std::nullopt;
+            return KiB * 1024;
+        }
+        return std::nullopt;
+    }
+} // namespace
+
+double threadCpuSeconds()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec TS;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &TS) == 0)
+        return TS.tv_sec + TS.tv_nsec * 1e-9;
+#endif
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+}
+
+uint64_t peakRSSBytes()
+{
+    // ru_maxrss не сбрасывается, а VmHWM сбрасывает resetPeakRSS.
+    if (auto HWM = procStatusBytes("VmHWM"))
+        return *HWM;
+    rusage Usage;
+    if (getrusage(RUSAGE_SELF, &Usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(Usage.ru_maxrss); // macOS отдаёт байты
+#else
+    return static_cast<uint64_t>(Usage.ru_maxrss) * 1024; // Linux - килобайты
+#endif
+}
+
+bool resetPeakRSS()
+{
+    std::error_code EC;
+    llvm::raw_fd_ostream OS("/proc/self/clear_refs", EC, llvm::sys::fs::CD_OpenExisting);
+    if (EC)
+        return false;
+    OS << "5"; // сброс пика RSS, см. proc(5)
+    OS.close();
+    if (!OS.has_error())
+        return true;
+    OS.clear_error();
+    return false;
+}
+
+RSSProbe::RSSProbe(bool ResetPeak)
+{
+    if (ResetPeak)
+        resetPeakRSS();
+    Baseline = peakRSSBytes();
+}
+
+void RSSProbe::finish(TUProfile &P) const
+{
+    P.PeakRSS = peakRSSBytes();
+    P.PeakRSSGrowth = P.PeakRSS > Baseline ? P.PeakRSS - Baseline : 0;
+}
+
+llvm::Expected<std::unique_ptr<StatsJournal>> StatsJournal::create(llvm::StringRef ReportPath)
+{
+    std::string Path = (ReportPath + ".partial").str();
+    std::error_code EC;
+    auto OS = std::make_unique<llvm::raw_fd_ostream>(Path, EC, llvm::sys::fs::OF_Text);
+    if (EC)
+        return llvm::createStringError(EC, "cannot write %s", Path.c_str());
+    return std::unique_ptr<StatsJournal>(new StatsJournal(std::move(Path), std::move(OS)));
+}
+
+StatsJournal::StatsJournal(std::string Path, std::unique_ptr<llvm::raw_fd_ostream> OS)
+    : Path(std::move(Path)), OS(std::move(OS))
+{
+}
+
+StatsJournal::~StatsJournal()
+{
+    if (OS)
+        OS->clear_error(); // ошибку записи журнала уже некому сообщать
+}
+
+void StatsJournal::started(llvm::StringRef File)
+{
+    write(llvm::formatv("{0}", llvm::json::Value(llvm::json::Object{{"file", File}, {"status", "started"}})).str());
+}
+
+void StatsJournal::finished(const TUProfile &P)
+{
+    auto TU = stats(P);
+    TU["file"] = P.File;
+    TU["status"] = P.Status;
+    write(llvm::formatv("{0}", llvm::json::Value(std::move(TU))).str());
+}
+
+void StatsJournal::remove()
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    if (!OS)
+        return;
+    OS->close();
+    OS->clear_error();
+    OS.reset();
+    llvm::sys::fs::remove(Path);
+}
+
+void StatsJournal::write(const std::string &Line)
+{
+    std::lock_guard<std::mutex> Lock(Mutex);
+    if (!OS)
+        return;
+    // Без буферизации до конца запуска: строка должна пережить гибель процесса.
+    *OS << Line << "\n";
+    OS->flush();
+}
+
+llvm::Error writeProfileReport(llvm::StringRef Path, std::vector<TUProfile> Profiles)
+{
+    TUProfile Total;
+    for (const auto &P : Profiles)
+    {
+        add(Total.Parse, P.Parse);
+        add(Total.Prepare, P.Prepare);
+        add(Total.Match, P.Match);
+        add(Total.Flush, P.Flush);
+        for (const auto &[Name, Seconds] : P.Matchers)
+            Total.Matchers[Name] += Seconds;
+        for (const auto &[Name, Stats] : P.Handlers)
+        {
+            Total.Handlers[Name].Seconds += Stats.Seconds;
+            Total.Handlers[Name].Calls += Stats.Calls;
+        }
+    }
+
+    llvm::stable_sort(Profiles, [](const TUProfile &L, const TUProfile &R)
+                      { return L.total() > R.total(); });
+    llvm::json::Array TUs;
+    for (const auto &P : Profiles)
+        TUs.push_back(llvm::json::Object{{"file", P.File},
+                                         {"seconds", P.total()},
+                                         {"phases", phases(P)},
+                                         {"matchers", matchers(P)},
+                                         {"handlers", handlers(P)}});
+
+    llvm::json::Value Report = llvm::json::Object{
+        {"total", llvm::json::Object{{"tus", static_cast<int64_t>(Profiles.size())},
+                                     {"seconds", Total.total()},
+                                     {"phases", phases(Total)},
+                                     {"matchers", matchers(Total)},
+                                     {"handlers", handlers(Total)}}},
+        {"translation_units", std::move(TUs)}};
+
+    return llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                               {
+                                   OS << llvm::formatv("{0:2}", Report) << "\n";
+                                   return llvm::Error::success(); });
+}
+
+llvm::Error writeStatsReport(llvm::StringRef Path, std::vector<TUProfile> Profiles, unsigned Duplicates,
+                             unsigned Conflicts)
+{
+    TUProfile Total;
+    std::map<std::string, int64_t> ByStatus;
+    for (const auto &P : Profiles)
+    {
+        ++ByStatus[P.Status];
+        add(Total.Parse, P.Parse);
+        add(Total.Prepare, P.Prepare);
+        add(Total.Match, P.Match);
+        add(Total.Flush, P.Flush);
+        Total.PeakRSS = std::max(Total.PeakRSS, P.PeakRSS);
+        Total.PeakRSSGrowth = std::max(Total.PeakRSSGrowth, P.PeakRSSGrowth);
+        Total.Decls += P.Decls;
+        Total.Stmts += P.Stmts;
+        Total.EditsApplied += P.EditsApplied;
+        for (const auto &[Name, Stats] : P.Handlers)
+            Total.Handlers[Name].Calls += Stats.Calls;
+        for (const auto &[Reason, Count] : P.EditsSkipped)
+            Total.EditsSkipped[Reason] += Count;
+    }
+
+    // Порядок по пути: два запуска по одному дереву дают сравнимые файлы.
+    llvm::stable_sort(Profiles, [](const TUProfile &L, const TUProfile &R)
+                      { return L.File < R.File; });
+    llvm::json::Array TUs;
+    for (const auto &P : Profiles)
+    {
+        auto TU = stats(P);
+        TU["file"] = P.File;
+        TU["status"] = P.Status;
+        TUs.push_back(std::move(TU));
+    }
+
+    auto Summary = stats(Total);
+    Summary["tus"] = toObject(ByStatus, [](int64_t N) { return N; });
+    Summary["merge"] = llvm::json::Object{{"duplicates", Duplicates}, {"conflicts", Conflicts}};
+    Summary["peak_rss_bytes"] = static_cast<int64_t>(std::max(Total.PeakRSS, peakRSSBytes()));
+    llvm::json::Value Report = llvm::json::Object{{"total", std::move(Summary)}, {"translation_units", std::move(TUs)}};
+
+    return llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                               {
+                                   OS << llvm::formatv("{0:2}", Report) << "\n";
+                                   return llvm::Error::success(); });
+}
@@ -0,0 +1,147 @@
+#include "TUScheduler.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace
+{
+    constexpr int64_t TimingsVersion = 1;
+
+    // Условная стоимость одного #include в байтах главного файла: заголовки проекта и
+    // стандартной библиотеки обычно во много раз больше самой TU.
+    constexpr double IncludeWeight = 16 * 1024;
+
+    std::string absolutePath(llvm::StringRef Path)
+    {
+        llvm::SmallString<256> Abs(Path);
+        llvm::sys::fs::make_absolute(Abs);
+        llvm::sys::path::remove_dots(Abs, /*remove_dot_dot=*/true);
+        return std::string(Abs);
+    }
+
+    // Оценка по тексту главного файла; без файла - нулевая.
+    double estimateFromSource(llvm::StringRef Path)
+    {
+        auto Buf = llvm::MemoryBuffer::getFile(Path, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+        if (!Buf)
+            return 0;
+        llvm::StringRef Text = (*Buf)->getBuffer();
+        size_t Includes = 0;
+        llvm::SmallVector<llvm::StringRef> Lines;
+        Text.split(Lines, '\n');
+        for (auto Line : Lines)
+        {
+            Line = Line.ltrim();
+            if (Line.consume_front("#") && Line.ltrim().starts_with("include"))
+                ++Includes;
+        }
+        return Text.size() + Includes * IncludeWeight;
+    }
+} // namespace
+
+llvm::Expected<TimingHistory> TimingHistory::load(llvm::StringRef Path)
+{
+    TimingHistory History;
+    auto Buf = llvm::MemoryBuffer::getFile(Path);
+    if (!Buf)
+    {
+        if (Buf.getError() == std::errc::no_such_file_or_directory)
+            return History;
+        return llvm::createStringError(Buf.getError(), "cannot read timings %s", Path.str().c_str());
+    }
+    auto Json = llvm::json::parse((*Buf)->getBuffer());
+    if (!Json)
+        return Json.takeError();
+    const auto *Root = Json->getAsObject();
+    const auto *TUs = Root ? Root->getObject("tus") : nullptr;
+    if (!TUs || Root->getInteger("version") != TimingsVersion)
+        return llvm::createStringError(llvm::inconvertibleErrorCode(), "malformed timings %s", Path.str().c_str());
+    for (const auto &[File, Value] : *TUs)
+        if (auto Seconds = Value.getAsNumber(); Seconds && *Seconds >= 0)
+            History.Seconds[File.str()] = *Seconds;
+    return History;
+}
+
+llvm::Error TimingHistory::save(llvm::StringRef Path) const
+{
+    // Ключи по порядку: файл не меняется от порядка обработки.
+    std::vector<llvm::StringRef> Files;
+    for (const auto &Entry : Seconds)
+        Files.push_back(Entry.first());
+    llvm::sort(Files);
+
+    return llvm::writeToOutput(Path, [&](llvm::raw_ostream &OS)
+                               {
+                                   llvm::json::OStream J(OS, 2);
+                                   J.object([&]
+                                            {
+                                                J.attribute("version", TimingsVersion);
+                                                J.attributeObject("tus", [&]
+                                                                  {
+                                                                      for (auto File : Files)
+                                                                          J.attribute(File, Seconds.lookup(File));
+                                                                  });
+                                            });
+                                   OS << "\n";
+                                   return llvm::Error::success(); });
+}
+
+void TimingHistory::record(llvm::StringRef File, double Seconds)
+{
+    auto [It, Inserted] = this->Seconds.try_emplace(File, Seconds);
+    if (!Inserted)
+        It->second = (It->second + Seconds) / 2;
+}
+
+std::optional<double> TimingHistory::seconds(llvm::StringRef File) const
+{
+    auto It = Seconds.find(File);
+    if (It == Seconds.end())
+        return std::nullopt;
+    return It->second;
+}
+
+std::vector<std::string> scheduleLargestFirst(llvm::ArrayRef<std::string> Files, const TimingHistory *History)
+{
+    struct Item
+    {
+        double Cost;
+        llvm::StringRef Path;
+    };
+    std::vector<Item> Items;
+    std::vector<double> Estimates;
+    double KnownSeconds = 0, KnownEstimate = 0;
+    std::vector<std::optional<double>> Known;
+    for (const auto &File : Files)
+    {
+        double Estimate = estimateFromSource(File);
+        Estimates.push_back(Estimate);
+        Known.push_back(History ? History->seconds(absolutePath(File)) : std::nullopt);
+        if (auto Seconds = Known.back())
+        {
+            KnownSeconds += *Seconds;
+            KnownEstimate += Estimate;
+        }
+    }
+
+    // Секунд на единицу оценки по TU с историей; без истории сравниваются сами оценки.
+    double Scale = KnownEstimate > 0 ? KnownSeconds / KnownEstimate : 1;
+    for (size_t I = 0; I < Files.size(); ++I)
+        Items.push_back({Known[I] ? *Known[I] : Estimates[I] * Scale, Files[I]});
+    llvm::sort(Items, [](const Item &L, const Item &R)
+               { return std::tie(R.Cost, L.Path) < std::tie(L.Cost, R.Path); });
+
+    std::vector<std::string> Result;
+    Result.reserve(Items.size());
+    for (const auto &It : Items)
+        Result.push_back(It.Path.str());
+    return Result;
+}
@@ -1,4 +1,12 @@
 #include "RefactorTool.h"
+#include "RefactorRunner.h"
+#include "RefactorServer.h"
+#include "HierarchySummary.h"
+#include "Sharding.h"
+#include "IncludeGraph.h"
+#include "GitChanges.h"
+#include "InMemoryRefactor.h"
+#include "ProfileData.h"
 
 #include "clang/Tooling/CommonOptionsParser.h"
 // #include "llvm/Support/CommandLine.h"
@@ -9,8 +17,195 @@ using namespace clang::tooling;
 
 static llvm::cl::OptionCategory ToolCategory("refactor-tool options");
 
+static llvm::cl::opt<unsigned> Jobs("j",
+                                    llvm::cl::desc("Количество потоков для обработки TU (0 - по числу ядер)"),
+                                    llvm::cl::value_desc("N"),
+                                    llvm::cl::init(1),
+                                    llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> EmitHierarchy("emit-hierarchy",
+                                              llvm::cl::desc("Фаза 1: сохранить сводки иерархии классов каждой TU в каталог, не изменяя файлы"),
+                                              llvm::cl::value_desc("dir"),
+                                              llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> UseHierarchy("hierarchy",
+                                             llvm::cl::desc("Фаза 2: объединить сводки из каталога и учитывать наследников из других TU (без --header-filter правит все несистемные заголовки)"),
+                                             llvm::cl::value_desc("dir"),
+                                             llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> CacheDir("cache-dir",
+                                         llvm::cl::desc("Каталог кэша результатов: неизменённые TU пропускаются, их правки применяются из кэша"),
+                                         llvm::cl::value_desc("dir"),
+                                         llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> PreambleDir("preamble-cache",
+                                            llvm::cl::desc("Каталог для PCH общих преамбул: повторно используемые #include разбираются один раз"),
+                                            llvm::cl::value_desc("dir"),
+                                            llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> Profile("profile",
+                                        llvm::cl::desc("Замерить время фаз, матчеров и обработчиков и записать JSON-отчёт по TU"),
+                                        llvm::cl::value_desc("file.json"),
+                                        llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> Stats("stats",
+                                      llvm::cl::desc("Записать JSON-статистику по TU: время фаз, пиковая память, размер AST, совпадения и пропущенные правки"),
+                                      llvm::cl::value_desc("file.json"),
+                                      llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> Serve("serve",
+                                      llvm::cl::desc("Режим сервера: принимать запросы через Unix-сокет, сохраняя разобранные заголовки и PCH между запросами"),
+                                      llvm::cl::value_desc("socket"),
+                                      llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<bool> Watch("watch",
+                                 llvm::cl::desc("С --serve: следить за изменением файлов и заранее пересобирать их преамбулы"),
+                                 llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> Connect("connect",
+                                        llvm::cl::desc("Отправить файлы серверу, запущенному с --serve, вместо обработки в этом процессе"),
+                                        llvm::cl::value_desc("socket"),
+                                        llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<bool> Shutdown("shutdown",
+                                    llvm::cl::desc("С --connect: завершить сервер"),
+                                    llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> ExportFixes("export-fixes",
+                                            llvm::cl::desc("Выгрузить правки в YAML (формат clang-apply-replacements), не изменяя исходники"),
+                                            llvm::cl::value_desc("file"),
+                                            llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> HeaderFilter("header-filter",
+                                             llvm::cl::desc("Регулярное выражение для путей заголовков, которые тоже нужно исправлять"),
+                                             llvm::cl::value_desc("regex"),
+                                             llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> Checks("checks",
+                                       llvm::cl::desc("Включённые проверки через запятую (по умолчанию все, кроме value-param): nv-dtor, override, range-for-copy, vector-reserve, value-param"),
+                                       llvm::cl::value_desc("list"),
+                                       llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> Shard("shard",
+                                      llvm::cl::desc("Обработать только шард i из N (0 <= i < N) и выгрузить его правки в --export-fixes; объединение - подкоманда merge"),
+                                      llvm::cl::value_desc("i/N"),
+                                      llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<bool> LimitTraversal("limit-traversal",
+                                          llvm::cl::desc("Сопоставлять матчеры только с объявлениями главного файла (и заголовков под --header-filter), а не со всем AST"),
+                                          llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<bool> SkipInstantiations("skip-instantiations",
+                                              llvm::cl::desc("Не сопоставлять матчеры с инстанцированиями шаблонов: каждый написанный узел проверяется один раз"),
+                                              llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<bool> Prefilter("prefilter",
+                                     llvm::cl::desc("Не разбирать TU, в главном файле которых нет лексем включённых проверок (~, class/struct, for); с value-param не действует"),
+                                     llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> ChangedSince("changed-since",
+                                             llvm::cl::desc("Обработать только TU, затронутые изменениями с ревизии git (по графу включений --include-graph)"),
+                                             llvm::cl::value_desc("rev"),
+                                             llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> IncludeGraphFile("include-graph",
+                                                 llvm::cl::desc("Файл графа включений, обновляемый каждым запуском (по умолчанию с --changed-since: .refactor-include-graph.json)"),
+                                                 llvm::cl::value_desc("file"),
+                                                 llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> ProfileDataFile("profile-data",
+                                                llvm::cl::desc("Профиль выполнения (текст llvm-profdata: инструментальный или сэмплы perf) для оценки правок range-for-copy"),
+                                                llvm::cl::value_desc("file"),
+                                                llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<uint64_t> CopyThreshold("copy-threshold",
+                                             llvm::cl::desc("range-for-copy и value-param: не заменять ссылкой копии тривиально копируемых типов не больше N байт"),
+                                             llvm::cl::value_desc("N"),
+                                             llvm::cl::init(16),
+                                             llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<uint64_t> ProfileThreshold("profile-threshold",
+                                                llvm::cl::desc("С --profile-data: делать правки range-for-copy только с оценкой не ниже порога (счётчик x байты x итерации)"),
+                                                llvm::cl::value_desc("N"),
+                                                llvm::cl::init(0),
+                                                llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> ProfileRanking("profile-ranking",
+                                               llvm::cl::desc("Записать кандидатов range-for-copy с оценками по убыванию (TSV)"),
+                                               llvm::cl::value_desc("file"),
+                                               llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<std::string> Timings("timings",
+                                        llvm::cl::desc("Файл с временем разбора TU: при -j > 1 самые долгие TU обрабатываются первыми"),
+                                        llvm::cl::value_desc("file"),
+                                        llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<bool> Stdin("stdin",
+                                 llvm::cl::desc("Читать содержимое единственного файла из stdin (несохранённый буфер редактора); требует --stdout"),
+                                 llvm::cl::cat(ToolCategory));
+
+static llvm::cl::opt<bool> Stdout("stdout",
+                                  llvm::cl::desc("Вывести исправленный единственный файл в stdout, не изменяя его на диске"),
+                                  llvm::cl::cat(ToolCategory));
+
+// Подкоманда merge: refactor_tool merge -o merged.yaml shard-*.yaml
+static llvm::cl::SubCommand MergeCommand("merge", "Объединить выгрузки шардов (--shard): схлопнуть повторы и сообщить о конфликтах");
+
+static llvm::cl::list<std::string> MergeInputs(llvm::cl::Positional,
+                                               llvm::cl::OneOrMore,
+                                               llvm::cl::desc("<shard.yaml>..."),
+                                               llvm::cl::sub(MergeCommand));
+
+static llvm::cl::opt<std::string> MergeOutput("o",
+                                              llvm::cl::desc("Записать объединённые правки в YAML"),
+                                              llvm::cl::value_desc("file"),
+                                              llvm::cl::sub(MergeCommand));
+
+static llvm::cl::opt<bool> MergeApply("apply",
+                                      llvm::cl::desc("Применить объединённые правки к файлам"),
+                                      llvm::cl::sub(MergeCommand));
+
+// Режим --stdin/--stdout: один файл рефакторится в памяти, результат выводится в stdout.
+static int refactorToStdout(const CompilationDatabase &Compilations, llvm::StringRef File,
+                            const RefactorOptions &Options)
+{
+    auto Commands = Compilations.getCompileCommands(File);
+    if (Commands.empty())
+    {
+        llvm::errs() << "No compile command for " << File << "\n";
+        return 1;
+    }
+    auto Buf = Stdin ? llvm::MemoryBuffer::getSTDIN() : llvm::MemoryBuffer::getFile(File);
+    if (!Buf)
+    {
+        llvm::errs() << "Cannot read " << (Stdin ? "stdin" : File) << ": " << Buf.getError().message() << "\n";
+        return 1;
+    }
+    auto Result = refactorCode((*Buf)->getBuffer(), Commands.front(), Options);
+    if (!Result)
+    {
+        llvm::errs() << llvm::toString(Result.takeError()) << "\n";
+        return 1;
+    }
+    llvm::outs() << Result->Code;
+    return 0;
+}
+
 int main(int argc, const char **argv)
 {
+    // Подкоманде merge база компиляции не нужна: она работает только с выгрузками шардов.
+    if (argc > 1 && llvm::StringRef(argv[1]) == "merge")
+    {
+        llvm::cl::ParseCommandLineOptions(argc, argv);
+        if (MergeOutput.empty() && !MergeApply)
+        {
+            llvm::errs() << "merge: specify -o <file> and/or --apply\n";
+            return 1;
+        }
+        return mergeShardFixes(std::vector<std::string>(MergeInputs.begin(), MergeInputs.end()), MergeOutput,
+                               MergeApply);
+    }
+
     // Парсер опций: Обрабатывает флаги командной строки, компиляционные базы данных.
     auto ExpectedParser = CommonOptionsParser::create(argc, argv, ToolCategory);
     if (!ExpectedParser)
@@ -19,8 +214,138 @@ int main(int argc, const char **argv)
         return 1;
     }
     CommonOptionsParser &OptionsParser = ExpectedParser.get();
-    // Создаем ClangTool
-    ClangTool Tool(OptionsParser.getCompilations(), OptionsParser.getSourcePathList());
-    // Запускаем RefactorAction.
-    return Tool.run(newFrontendActionFactory<CodeRefactorAction>().get());
-}
\ No newline at end of file
+
+    // Клиенту сервера база компиляции не нужна: файлы разбирает сервер.
+    if (!Connect.empty())
+        return Shutdown ? requestShutdown(Connect)
+                        : requestRefactor(Connect, OptionsParser.getSourcePathList());
+
+    RunOptions Options;
+    Options.Jobs = Jobs;
+    Options.EmitHierarchyDir = EmitHierarchy;
+    Options.CacheDir = CacheDir;
+    Options.ExportFixes = ExportFixes;
+    Options.PreambleDir = PreambleDir;
+    Options.ProfileReport = Profile;
+    Options.StatsReport = Stats;
+    Options.Prefilter = Prefilter;
+    Options.TimingsFile = Timings;
+
+    if (!HeaderFilter.empty())
+    {
+        std::string Error;
+        if (!llvm::Regex(HeaderFilter).isValid(Error))
+        {
+            llvm::errs() << "Invalid --header-filter: " << Error << "\n";
+            return 1;
+        }
+        Options.Refactor.HeaderFilter = HeaderFilter;
+    }
+
+    auto EnabledChecks = parseCheckList(Checks);
+    if (!EnabledChecks)
+    {
+        llvm::errs() << "Invalid --checks: " << llvm::toString(EnabledChecks.takeError()) << "\n";
+        return 1;
+    }
+    Options.Refactor.Checks = std::move(*EnabledChecks);
+    Options.Refactor.LimitTraversal = LimitTraversal;
+    Options.Refactor.SkipInstantiations = SkipInstantiations;
+    Options.Refactor.CopyThreshold = CopyThreshold;
+
+    GlobalHierarchy Hierarchy;
+    if (!UseHierarchy.empty())
+    {
+        if (auto Err = Hierarchy.loadDirectory(UseHierarchy))
+        {
+            llvm::errs() << llvm::toString(std::move(Err)) << "\n";
+            return 1;
+        }
+        llvm::errs() << "Loaded " << Hierarchy.summaryCount() << " hierarchy summaries: "
+                     << Hierarchy.edgeCount() << " edges, " << Hierarchy.baseCount() << " base classes\n";
+        Options.Refactor.Hierarchy = &Hierarchy;
+    }
+
+    FunctionProfile FunctionCounts;
+    if (!ProfileDataFile.empty())
+    {
+        auto Loaded = FunctionProfile::load(ProfileDataFile);
+        if (!Loaded)
+        {
+            llvm::errs() << llvm::toString(Loaded.takeError()) << "\n";
+            return 1;
+        }
+        FunctionCounts = std::move(*Loaded);
+        llvm::errs() << "Loaded profile: " << FunctionCounts.size() << " functions\n";
+        Options.Refactor.ProfileData = &FunctionCounts;
+        Options.Refactor.ProfileThreshold = ProfileThreshold;
+    }
+    else if (ProfileThreshold)
+    {
+        llvm::errs() << "--profile-threshold requires --profile-data\n";
+        return 1;
+    }
+    Options.ProfileRanking = ProfileRanking;
+
+    if (Stdin || Stdout)
+    {
+        if (OptionsParser.getSourcePathList().size() != 1 || (Stdin && !Stdout))
+        {
+            llvm::errs() << "--stdout expects exactly one source file; --stdin requires --stdout\n";
+            return 1;
+        }
+        return refactorToStdout(OptionsParser.getCompilations(), OptionsParser.getSourcePathList().front(),
+                                Options.Refactor);
+    }
+
+    if (!Serve.empty())
+        return serveRefactor(OptionsParser.getCompilations(), Options, Serve,
+                             OptionsParser.getSourcePathList(), Watch);
+
+    std::vector<std::string> Sources = OptionsParser.getSourcePathList();
+    Options.IncludeGraphPath = IncludeGraphFile;
+    if (!ChangedSince.empty())
+    {
+        if (Options.IncludeGraphPath.empty())
+            Options.IncludeGraphPath = ".refactor-include-graph.json";
+        auto Changed = gitChangedFiles(ChangedSince);
+        if (!Changed)
+        {
+            llvm::errs() << "Cannot list changes since " << ChangedSince << ": " << llvm::toString(Changed.takeError())
+                         << "\n";
+            return 1;
+        }
+        // Без графа (первый запуск) затронутыми считаются все TU, и граф заполняется.
+        IncludeGraph Graph;
+        if (auto Loaded = IncludeGraph::load(Options.IncludeGraphPath))
+            Graph = std::move(*Loaded);
+        else
+            llvm::errs() << "Ignoring include graph: " << llvm::toString(Loaded.takeError()) << "\n";
+        size_t Total = Sources.size();
+        Sources = Graph.affected(Sources, *Changed, OptionsParser.getCompilations());
+        llvm::errs() << "Changed since " << ChangedSince << ": " << Changed->size() << " files, " << Sources.size()
+                     << " of " << Total << " TUs affected\n";
+    }
+    if (!Shard.empty())
+    {
+        auto Spec = parseShardSpec(Shard);
+        if (!Spec)
+        {
+            llvm::errs() << "Invalid --shard: " << llvm::toString(Spec.takeError()) << "\n";
+            return 1;
+        }
+        if (ExportFixes.empty())
+        {
+            llvm::errs() << "--shard requires --export-fixes: each shard writes its own edits\n";
+            return 1;
+        }
+        size_t Total = Sources.size();
+        Sources = selectShard(Sources, *Spec);
+        Options.ExportUnmerged = true;
+        llvm::errs() << "Shard " << Spec->Index << "/" << Spec->Count << ": " << Sources.size() << " of " << Total
+                     << " files\n";
+    }
+
+    // Запускаем RefactorAction для всех TU на пуле потоков.
+    return runRefactor(OptionsParser.getCompilations(), Sources, Options);
+}
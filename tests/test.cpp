@@ -2,48 +2,39 @@
 
 #include "clang/ASTMatchers/ASTMatchers.h"
 #include "clang/ASTMatchers/ASTMatchFinder.h"
+#include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendActions.h"
 #include "clang/Tooling/CommonOptionsParser.h"
 #include "clang/Tooling/Tooling.h"
 #include "clang/Tooling/Refactoring.h"
 #include "clang/Rewrite/Core/Rewriter.h"
+#include "clang/Tooling/ReplacementsYaml.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/YAMLTraits.h"
 
 #include "RefactorTool.h"
+#include "RefactorPlugin.h"
+#include "InMemoryRefactor.h"
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <string>
 #include <stdexcept>
 
 using namespace clang::tooling;
 
+// Рефакторинг в памяти, без временных файлов. Как прежде при записи на диск,
+// без правок возвращается пустая строка.
 static std::string runToolAndReadFile(const std::string &Code)
 {
-    llvm::SmallString<64> TempPath;
-    if (auto EC = llvm::sys::fs::createTemporaryFile("refactor_test", "cpp", TempPath))
-        throw std::runtime_error(std::string("Cannot create temporary file: ") + EC.message());
-
-    std::string FileName = std::string(TempPath.c_str());
-    std::vector<std::string> Args = {"-std=c++20"};
-    if (!runToolOnCodeWithArgs(std::make_unique<CodeRefactorAction>(), Code, Args, FileName))
-    {
-        llvm::sys::fs::remove(FileName);
-        throw std::runtime_error("Tool execution failed");
-    }
-
-    std::ifstream ifs(FileName);
-    if (!ifs.good())
-    {
-        llvm::sys::fs::remove(FileName);
-        throw std::runtime_error("Cannot open resulting file");
-    }
-    std::string Content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
-    ifs.close();
-
-    llvm::sys::fs::remove(FileName);
-    return Content;
+    auto Result = refactorCode(Code, {"-std=c++20"}, "input.cpp");
+    if (!Result)
+        throw std::runtime_error("Tool execution failed: " + llvm::toString(Result.takeError()));
+    return Result->Edits.empty() ? std::string() : Result->Code;
 }
 
 // ---------- Tests for non-virtual destructor ----------
@@ -83,6 +74,70 @@ Base::~Base() {}
     EXPECT_EQ(Out.find("virtual ~Base"), std::string::npos);
 }
 
+TEST(RefactorTool, AddVirtualToDtor_WhenDerivedInNamespaceOrNested)
+{
+    const std::string Code = R"cpp(
+namespace lib {
+class Base {
+public:
+    ~Base() {}
+};
+}
+
+namespace app::detail {
+class Derived : public lib::Base {};
+}
+
+class Outer {
+    class NestedBase {
+    public:
+        ~NestedBase() {}
+    };
+    class Nested : public NestedBase {};
+};
+)cpp";
+
+    std::string Out = runToolAndReadFile(Code);
+    EXPECT_NE(Out.find("virtual ~Base"), std::string::npos);
+    EXPECT_NE(Out.find("virtual ~NestedBase"), std::string::npos);
+}
+
+TEST(RefactorTool, AddVirtualToDtor_ManyClassesInNamespaces)
+{
+    // Тысячи пар база/наследник в разных пространствах имён: индекс иерархии строится один
+    // раз, поэтому время растёт линейно. Прежний перебор всех записей для каждого деструктора
+    // квадратичен: в 4 раза больше классов - в 16 раз дольше. Порог 8x оставляет запас на шум.
+    auto run = [](int Classes)
+    {
+        std::string Code;
+        for (int i = 0; i < Classes; ++i)
+        {
+            auto Id = std::to_string(i);
+            Code += "namespace base_ns" + Id + " { struct Base" + Id + " { ~Base" + Id + "() {} }; }\n";
+            Code += "namespace derived_ns" + Id + " { struct Derived" + Id + " : base_ns" + Id + "::Base" + Id + " {}; }\n";
+            Code += "namespace lone_ns" + Id + " { struct Lone" + Id + " { ~Lone" + Id + "() {} }; }\n";
+        }
+
+        auto Start = std::chrono::steady_clock::now();
+        std::string Out = runToolAndReadFile(Code);
+        auto Elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - Start).count();
+
+        size_t Count = 0;
+        for (auto Pos = Out.find("virtual ~"); Pos != std::string::npos; Pos = Out.find("virtual ~", Pos + 1))
+            ++Count;
+        EXPECT_EQ(Count, static_cast<size_t>(Classes));
+        EXPECT_EQ(Out.find("virtual ~Lone"), std::string::npos);
+        return Elapsed;
+    };
+
+    // Лучшее из двух запусков малого размера: первый прогревает кэши ФС и аллокатора.
+    double Small = std::min(run(750), run(750));
+    double Large = run(3000);
+    RecordProperty("elapsed_ms_750", static_cast<int>(Small));
+    RecordProperty("elapsed_ms_3000", static_cast<int>(Large));
+    EXPECT_LT(Large, 8 * Small) << "750 classes: " << Small << " ms, 3000 classes: " << Large << " ms";
+}
+
 // ---------- Tests for missing override ----------
 
 TEST(RefactorTool, AddOverrideToMethod_WhenOverrides)
@@ -136,6 +191,43 @@ public:
     EXPECT_NE(Out.find("void fooSix() /*some*/ const override "), std::string::npos);
 }
 
+TEST(RefactorTool, AddOverrideToMethod_ComplexDeclarators)
+{
+    const std::string Code = R"cpp(
+class Base {
+public:
+    virtual void a(int x = (1 + 2));
+    virtual decltype(1) b() const;
+    virtual void c() noexcept(noexcept(1));
+    virtual void d() = 0;
+    virtual auto e() const -> int;
+    virtual void f() __attribute__((cold));
+};
+
+class Derived : public Base {
+public:
+    void a(int x = (1 + 2));
+    decltype(1) b() const;
+    void c() noexcept(noexcept(1));
+    void d();
+    auto e() const -> int;
+    void f() __attribute__((cold));
+};
+
+void Derived::a(int x) {}
+)cpp";
+
+    std::string Out = runToolAndReadFile(Code);
+    EXPECT_NE(Out.find("    void a(int x = (1 + 2)) override;"), std::string::npos);
+    EXPECT_NE(Out.find("    decltype(1) b() const override;"), std::string::npos);
+    EXPECT_NE(Out.find("    void c() noexcept(noexcept(1)) override;"), std::string::npos);
+    EXPECT_NE(Out.find("    void d() override;"), std::string::npos);
+    EXPECT_NE(Out.find("    auto e() const -> int override;"), std::string::npos);
+    EXPECT_NE(Out.find("    void f() __attribute__((cold)) override;"), std::string::npos);
+    // Определение вне класса не меняется: override допустим только в объявлении.
+    EXPECT_NE(Out.find("void Derived::a(int x) {}"), std::string::npos);
+}
+
 TEST(RefactorTool, DontDuplicateOverride_WhenAlreadyPresent)
 {
     const std::string Code = R"cpp(
@@ -213,4 +305,309 @@ void f() {
 
     std::string Out = runToolAndReadFile(Code);
     EXPECT_TRUE(Out.empty()); // пустой вывод когда ничего не поменялось
-}
\ No newline at end of file
+}
+TEST(RefactorTool, RangeForCopy_UsesCopyCostAndMutation)
+{
+    const std::string Code = R"cpp(
+#include <string>
+#include <vector>
+struct Small { int a, b; };
+struct Big { char data[64]; };
+void touch(std::string &);
+void f(const std::vector<Small> &s, const std::vector<Big> &b, const std::vector<std::string> &v) {
+    for (const Small x : s) (void)x;
+    for (const Big x : b) (void)x;
+    for (auto x : v) (void)x.size();
+    for (std::string x : v) x += "!";
+    for (auto x : v) touch(x);
+    for (auto x : s) (void)x;
+}
+)cpp";
+
+    auto Result = refactorCode(Code, {"-std=c++20"}, "input.cpp");
+    ASSERT_TRUE(bool(Result)) << llvm::toString(Result.takeError());
+    const auto &Out = Result->Code;
+    EXPECT_NE(Out.find("for (const Small x : s)"), std::string::npos); // 8 байт, тривиальный
+    EXPECT_NE(Out.find("for (const Big& x : b)"), std::string::npos);
+    EXPECT_NE(Out.find("for (const auto& x : v) (void)x.size();"), std::string::npos);
+    EXPECT_NE(Out.find("for (std::string x : v) x += "), std::string::npos);
+    EXPECT_NE(Out.find("for (auto x : v) touch(x);"), std::string::npos);
+    EXPECT_NE(Out.find("for (auto x : s)"), std::string::npos);
+
+    // Порог 0: любая копия непримитивного типа дорогая.
+    RefactorOptions Options;
+    Options.CopyThreshold = 0;
+    auto Strict = refactorCode(Code, {"-std=c++20"}, "input.cpp", Options);
+    ASSERT_TRUE(bool(Strict)) << llvm::toString(Strict.takeError());
+    EXPECT_NE(Strict->Code.find("for (const Small& x : s)"), std::string::npos);
+    EXPECT_NE(Strict->Code.find("for (const auto& x : s)"), std::string::npos);
+}
+
+// ---------- vector reserve ----------
+
+TEST(RefactorTool, VectorReserve_BeforeLoopsWithKnownTripCount)
+{
+    const std::string Code = R"cpp(
+#include <cstddef>
+#include <vector>
+void f(std::size_t n, const std::vector<int> &src, int m) {
+    std::vector<int> a;
+    for (std::size_t i = 0; i < n; ++i)
+        a.push_back(i);
+    std::vector<int> b;
+    for (int x : src) {
+        b.emplace_back(x);
+    }
+    int arr[4] = {};
+    std::vector<int> c;
+    for (int x : arr) c.push_back(x);
+}
+)cpp";
+
+    std::string Out = runToolAndReadFile(Code);
+    EXPECT_NE(Out.find("    std::vector<int> a;\n    a.reserve(n);\n    for (std::size_t i"), std::string::npos);
+    EXPECT_NE(Out.find("    b.reserve(src.size());\n    for (int x : src)"), std::string::npos);
+    EXPECT_NE(Out.find("    c.reserve(4);\n    for (int x : arr)"), std::string::npos);
+}
+
+TEST(RefactorTool, VectorReserve_NotWhenCountUnknown)
+{
+    const std::string Code = R"cpp(
+#include <cstddef>
+#include <vector>
+void g(std::size_t n, int m, const std::vector<int> &src) {
+    std::vector<int> conditional;
+    for (std::size_t i = 0; i < n; ++i)
+        if (i % 2) conditional.push_back(i);
+    std::vector<int> reserved;
+    reserved.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+        reserved.push_back(i);
+    std::vector<int> prefilled(3);
+    for (std::size_t i = 0; i < n; ++i)
+        prefilled.push_back(i);
+    std::vector<int> signedCount;
+    for (int i = 0; i < m; ++i)
+        signedCount.push_back(i);
+    std::vector<int> early;
+    for (int x : src) {
+        if (x < 0) break;
+        early.push_back(x);
+    }
+}
+)cpp";
+
+    std::string Out = runToolAndReadFile(Code);
+    EXPECT_TRUE(Out.empty()) << Out;
+}
+
+// ---------- value params ----------
+
+TEST(RefactorTool, ValueParam_ConstRefOrMove)
+{
+    const std::string Code = R"cpp(
+#include <string>
+#include <vector>
+namespace {
+struct Small { int a, b; };
+std::size_t len(std::string s);
+std::size_t len(std::string s) { return s.size(); }
+struct Person {
+    Person(std::string n) : name(n) {}
+    void rename(std::string n) { name = n; }
+    std::string name;
+};
+int small(Small s) { return s.a + s.b; }
+std::string shout(std::string s) { s += "!"; return s; }
+std::string same(std::string s) { return s; }
+struct Base { virtual std::size_t size(std::string s) { return s.size(); } };
+std::size_t callback(std::string s) { return s.size(); }
+auto *Ptr = &callback;
+void twice(std::vector<int> v) { std::vector<int> a = v; std::vector<int> b = v; }
+template <class T> std::size_t tmpl(T, std::string s) { return s.size(); }
+std::size_t (*TmplPtr)(int, std::string) = &tmpl<int>;
+}
+)cpp";
+
+    // По умолчанию проверка выключена.
+    EXPECT_TRUE(runToolAndReadFile(Code).empty());
+
+    RefactorOptions Options;
+    Options.Checks = {"value-param"};
+    auto Result = refactorCode(Code, {"-std=c++20"}, "input.cpp", Options);
+    ASSERT_TRUE(bool(Result)) << llvm::toString(Result.takeError());
+    const std::string &Out = Result->Code;
+    EXPECT_NE(Out.find("std::size_t len(const std::string& s);\nstd::size_t len(const std::string& s) {"),
+              std::string::npos);
+    EXPECT_NE(Out.find("Person(std::string n) : name(std::move(n)) {}"), std::string::npos);
+    EXPECT_NE(Out.find("void rename(std::string n) { name = std::move(n); }"), std::string::npos);
+    EXPECT_NE(Out.find("void twice(const std::vector<int>& v)"), std::string::npos);
+    // Дешёвая копия, изменение, возврат, виртуальный метод и взятый адрес (в том числе
+    // специализации шаблона) - без правок.
+    EXPECT_NE(Out.find("int small(Small s)"), std::string::npos);
+    EXPECT_NE(Out.find("std::string shout(std::string s)"), std::string::npos);
+    EXPECT_NE(Out.find("std::string same(std::string s)"), std::string::npos);
+    EXPECT_NE(Out.find("virtual std::size_t size(std::string s)"), std::string::npos);
+    EXPECT_NE(Out.find("std::size_t callback(std::string s)"), std::string::npos);
+    EXPECT_NE(Out.find("std::size_t tmpl(T, std::string s)"), std::string::npos);
+}
+
+TEST(RefactorTool, ValueParam_KeepsExternalSignatures)
+{
+    // Внешнее связывание и объявление только в .cpp: другая TU может объявить функцию
+    // сама или взять её адрес, поэтому сигнатура не меняется. std::move сигнатуру не трогает.
+    const std::string Code = R"cpp(
+#include <string>
+std::size_t len(std::string s);
+std::size_t len(std::string s) { return s.size(); }
+struct Person {
+    Person(std::string n) : name(n) {}
+    std::size_t size(std::string s) const { return s.size() + name.size(); }
+    std::string name;
+};
+static std::size_t local(std::string s) { return s.size(); }
+)cpp";
+
+    RefactorOptions Options;
+    Options.Checks = {"value-param"};
+    auto Result = refactorCode(Code, {"-std=c++20"}, "input.cpp", Options);
+    ASSERT_TRUE(bool(Result)) << llvm::toString(Result.takeError());
+    const std::string &Out = Result->Code;
+    EXPECT_NE(Out.find("std::size_t len(std::string s);\nstd::size_t len(std::string s) {"), std::string::npos);
+    EXPECT_NE(Out.find("std::size_t size(std::string s) const"), std::string::npos);
+    EXPECT_NE(Out.find("Person(std::string n) : name(std::move(n)) {}"), std::string::npos);
+    EXPECT_NE(Out.find("static std::size_t local(const std::string& s)"), std::string::npos);
+}
+
+TEST(RefactorTool, ValueParam_MoveOnlyWhenStdMoveDeclared)
+{
+    // <utility> не включён до первого конструктора: std::move там не объявлен.
+    const std::string Code = R"cpp(
+struct Big { Big(); Big(const Big &); char data[64]; };
+namespace {
+struct Early { Early(Big b) : big(b) {} Big big; };
+}
+#include <utility>
+namespace {
+struct Late { Late(Big b) : big(b) {} Big big; };
+}
+)cpp";
+
+    RefactorOptions Options;
+    Options.Checks = {"value-param"};
+    auto Result = refactorCode(Code, {"-std=c++20"}, "input.cpp", Options);
+    ASSERT_TRUE(bool(Result)) << llvm::toString(Result.takeError());
+    const std::string &Out = Result->Code;
+    EXPECT_NE(Out.find("Early(const Big& b) : big(b) {}"), std::string::npos);
+    EXPECT_NE(Out.find("Late(Big b) : big(std::move(b)) {}"), std::string::npos);
+}
+
+// ---------- Template instantiations ----------
+
+TEST(RefactorTool, SkipInstantiations_SameEditsOnWrittenCode)
+{
+    const std::string Code = R"cpp(
+#include <vector>
+struct Heavy { Heavy(){} Heavy(const Heavy&){} };
+struct Base { virtual ~Base() {} virtual void foo() {} };
+template <class T> struct Holder { ~Holder() {} T value; };
+template <class T> struct Box : Base {
+    void foo() {}
+    int sum(const std::vector<Heavy> &v) { int s = 0; for (const Heavy h : v) (void)h; return s; }
+};
+template <class B> struct Wrapped : B { void foo() {} };
+struct A {}; struct C {};
+template struct Box<A>;
+template struct Box<C>;
+struct UseA : Holder<A> {};
+struct UseC : Holder<C> {};
+void g() { Wrapped<Base> W; W.foo(); }
+)cpp";
+
+    auto AsIs = refactorCode(Code, {"-std=c++20"}, "input.cpp");
+    ASSERT_TRUE(bool(AsIs)) << llvm::toString(AsIs.takeError());
+    RefactorOptions Options;
+    Options.SkipInstantiations = true;
+    auto Spelled = refactorCode(Code, {"-std=c++20"}, "input.cpp", Options);
+    ASSERT_TRUE(bool(Spelled)) << llvm::toString(Spelled.takeError());
+
+    // Наследники шаблона - только его инстанцирования; база Wrapped видна только в инстанцировании.
+    EXPECT_NE(AsIs->Code.find("virtual ~Holder"), std::string::npos);
+    EXPECT_NE(AsIs->Code.find("struct Wrapped : B { void foo() override"), std::string::npos);
+    EXPECT_NE(AsIs->Code.find("const Heavy& h"), std::string::npos);
+    EXPECT_EQ(Spelled->Code, AsIs->Code);
+    EXPECT_EQ(Spelled->Edits.size(), 4u); // ~Holder, Box::foo, Wrapped::foo, range-for
+}
+
+// ---------- In-memory API ----------
+
+TEST(InMemoryRefactor, ReturnsEditsWithoutTouchingDisk)
+{
+    llvm::SmallString<64> Dir;
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("refactor_in_memory", Dir));
+    // Заголовок читается с диска, главный файл - только из буфера.
+    std::ofstream((Dir + "/base.h").str()) << "struct Base { virtual void foo(); };\n";
+    const std::string Code = "#include \"base.h\"\nstruct Derived : Base { void foo(); };\n";
+
+    CompileCommand Command(Dir, "input.cpp", {"clang++", "-std=c++20", "-c", "input.cpp", "-o", "input.o"}, "input.o");
+    auto Result = refactorCode(Code, Command);
+    ASSERT_TRUE(bool(Result)) << llvm::toString(Result.takeError());
+    EXPECT_EQ(Result->Code, "#include \"base.h\"\nstruct Derived : Base { void foo() override; };\n");
+    ASSERT_EQ(Result->Edits.size(), 1u);
+    EXPECT_EQ(Result->Edits[0].getOffset(), Code.find("()") + 2);
+    EXPECT_FALSE(llvm::sys::fs::exists(Dir + "/input.cpp"));
+    EXPECT_FALSE(llvm::sys::fs::exists(Dir + "/input.o"));
+
+    // Без правок буфер возвращается как есть, ошибка разбора - с диагностикой.
+    auto Same = refactorCode("int x;\n", {"-std=c++20"}, "same.cpp");
+    ASSERT_TRUE(bool(Same));
+    EXPECT_EQ(Same->Code, "int x;\n");
+    EXPECT_TRUE(Same->Edits.empty());
+    auto Broken = refactorCode("int f( {\n", {"-std=c++20"}, "broken.cpp");
+    ASSERT_FALSE(bool(Broken));
+    EXPECT_NE(llvm::toString(Broken.takeError()).find("error"), std::string::npos);
+
+    llvm::sys::fs::remove_directories(Dir);
+}
+
+// ---------- Clang plugin ----------
+
+TEST(RefactorPlugin, WritesFixesWithoutTouchingSource)
+{
+    llvm::SmallString<64> Dir;
+    ASSERT_FALSE(llvm::sys::fs::createUniqueDirectory("refactor_plugin", Dir));
+    std::string Fixes = (Dir + "/fixes.yaml").str();
+
+    const std::string Code = R"cpp(
+class Base {
+public:
+    virtual void foo() {}
+    ~Base() {}
+};
+class Derived : public Base {
+public:
+    void foo() {}
+};
+)cpp";
+
+    // Как при -fplugin-arg-refactor-...: аргументы разбираются до запуска действия.
+    auto Action = std::make_unique<RefactorPluginAction>();
+    clang::CompilerInstance CI;
+    ASSERT_TRUE(Action->ParseArgs(CI, {"fixes=" + Fixes, "checks=override"}));
+    ASSERT_TRUE(runToolOnCodeWithArgs(std::move(Action), Code, {"-std=c++20"}, (Dir + "/input.cpp").str()));
+
+    // Исходник не записывается, правки только в YAML.
+    EXPECT_FALSE(llvm::sys::fs::exists(Dir + "/input.cpp"));
+    auto Buf = llvm::MemoryBuffer::getFile(Fixes);
+    ASSERT_TRUE(bool(Buf));
+    TranslationUnitReplacements TUR;
+    llvm::yaml::Input YAML((*Buf)->getBuffer());
+    YAML >> TUR;
+    ASSERT_FALSE(YAML.error());
+
+    EXPECT_TRUE(llvm::StringRef(TUR.MainSourceFile).ends_with("input.cpp"));
+    ASSERT_EQ(TUR.Replacements.size(), 1u); // только override: nv-dtor выключен
+    EXPECT_EQ(TUR.Replacements[0].getReplacementText(), " override");
+
+    llvm::sys::fs::remove_directories(Dir);
+}
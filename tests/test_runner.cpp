@@ -0,0 +1,1075 @@
+#include <gtest/gtest.h>
+
+#include "clang/Tooling/CompilationDatabase.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_socket_stream.h"
+
+#include "RefactorRunner.h"
+#include "HierarchySummary.h"
+#include "ResultCache.h"
+#include "EditCollector.h"
+#include "RefactorServer.h"
+#include "RefactorCheck.h"
+#include "Sharding.h"
+#include "LexicalPrefilter.h"
+#include "IncludeGraph.h"
+#include "GitChanges.h"
+#include "ProfileData.h"
+#include "TUScheduler.h"
+#include "TUProfile.h"
+
+#include "clang/Tooling/ReplacementsYaml.h"
+#include "llvm/Support/YAMLTraits.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <stdexcept>
+#include <vector>
+
+using namespace clang::tooling;
+
+namespace
+{
+    // Временный каталог с набором исходников, удаляется в деструкторе.
+    class TempTree
+    {
+    public:
+        TempTree()
+        {
+            if (auto EC = llvm::sys::fs::createUniqueDirectory("refactor_runner_test", Root))
+                throw std::runtime_error(std::string("Cannot create temporary directory: ") + EC.message());
+        }
+
+        ~TempTree()
+        {
+            llvm::sys::fs::remove_directories(Root);
+        }
+
+        std::string add(const std::string &Name, const std::string &Code)
+        {
+            llvm::SmallString<128> Path(Root);
+            llvm::sys::path::append(Path, Name);
+            std::ofstream(std::string(Path)) << Code;
+            return std::string(Path);
+        }
+
+        std::string root() const { return std::string(Root); }
+
+    private:
+        llvm::SmallString<128> Root;
+    };
+
+    std::string readFile(const std::string &Path)
+    {
+        std::ifstream ifs(Path);
+        return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    }
+
+    const std::string kSource = R"cpp(
+#include <vector>
+struct Heavy { Heavy(){} Heavy(const Heavy&){} };
+class Base {
+public:
+    virtual void foo() {}
+    ~Base() {}
+};
+class Derived : public Base {
+public:
+    void foo() {}
+};
+void f(const std::vector<Heavy> &v) {
+    for (const Heavy h : v) { (void)h; }
+}
+)cpp";
+
+    const std::string kExpected = R"cpp(
+#include <vector>
+struct Heavy { Heavy(){} Heavy(const Heavy&){} };
+class Base {
+public:
+    virtual void foo() {}
+    virtual ~Base() {}
+};
+class Derived : public Base {
+public:
+    void foo() override {}
+};
+void f(const std::vector<Heavy> &v) {
+    for (const Heavy& h : v) { (void)h; }
+}
+)cpp";
+} // namespace
+
+TEST(RefactorRunner, ParallelRunMatchesSerial)
+{
+    TempTree Serial, Parallel;
+    std::vector<std::string> SerialFiles, ParallelFiles;
+    for (int i = 0; i < 8; ++i)
+    {
+        auto Name = "tu" + std::to_string(i) + ".cpp";
+        SerialFiles.push_back(Serial.add(Name, kSource));
+        ParallelFiles.push_back(Parallel.add(Name, kSource));
+    }
+
+    RunOptions Options;
+    Options.Jobs = 1;
+    FixedCompilationDatabase SerialDB(Serial.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(SerialDB, SerialFiles, Options), 0);
+
+    Options.Jobs = 4;
+    FixedCompilationDatabase ParallelDB(Parallel.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(ParallelDB, ParallelFiles, Options), 0);
+
+    for (size_t i = 0; i < SerialFiles.size(); ++i)
+    {
+        EXPECT_EQ(readFile(SerialFiles[i]), kExpected);
+        EXPECT_EQ(readFile(ParallelFiles[i]), readFile(SerialFiles[i]));
+    }
+}
+
+TEST(RefactorRunner, DuplicateSourcesAreProcessedOnce)
+{
+    TempTree Tree;
+    auto File = Tree.add("dup.cpp", kSource);
+
+    RunOptions Options;
+    Options.Jobs = 4;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File, File, File}, Options), 0);
+
+    EXPECT_EQ(readFile(File), kExpected);
+}
+
+TEST(HierarchySummary, RoundTripAndMerge)
+{
+    TempTree Tree;
+    llvm::SmallString<128> First(Tree.root()), Second(Tree.root());
+    llvm::sys::path::append(First, std::string("a") + HierarchySummaryExt.str());
+    llvm::sys::path::append(Second, std::string("b") + HierarchySummaryExt.str());
+
+    ASSERT_FALSE(bool(writeHierarchySummary(First, {{"c:@S@Base", "c:@S@A"}, {"c:@S@Base", "c:@S@A"}})));
+    ASSERT_FALSE(bool(writeHierarchySummary(Second, {{"c:@S@Base", "c:@S@B"}, {"c:@N@ns@S@Other", "c:@S@C"}})));
+
+    GlobalHierarchy Hierarchy;
+    ASSERT_FALSE(bool(Hierarchy.loadDirectory(Tree.root())));
+    EXPECT_EQ(Hierarchy.summaryCount(), 2u);
+    EXPECT_EQ(Hierarchy.edgeCount(), 3u); // повторное ребро в первом файле схлопнуто
+    EXPECT_EQ(Hierarchy.baseCount(), 2u);
+    EXPECT_TRUE(Hierarchy.hasDerived("c:@S@Base"));
+    EXPECT_TRUE(Hierarchy.hasDerived("c:@N@ns@S@Other"));
+    EXPECT_FALSE(Hierarchy.hasDerived("c:@S@A"));
+}
+
+TEST(HierarchySummary, RejectsMalformedFile)
+{
+    TempTree Tree;
+    auto Path = Tree.add(std::string("bad") + HierarchySummaryExt.str(), "RTHS\x01");
+
+    GlobalHierarchy Hierarchy;
+    auto Err = Hierarchy.load(Path);
+    EXPECT_TRUE(bool(Err));
+    llvm::consumeError(std::move(Err));
+}
+
+TEST(RefactorRunner, CrossTUHierarchyAddsVirtual)
+{
+    // База объявлена в заголовке, который сам TU не является; наследник - в другом .cpp.
+    TempTree Tree;
+    auto Header = Tree.add("base.h", "#pragma once\nclass Base {\npublic:\n    ~Base() {}\n};\n");
+    auto User = Tree.add("a.cpp", "#include \"base.h\"\nvoid use(Base &b) { (void)b; }\n");
+    auto Derived = Tree.add("b.cpp", "#include \"base.h\"\nclass Derived : public Base {};\n");
+    llvm::SmallString<128> SummaryDir(Tree.root());
+    llvm::sys::path::append(SummaryDir, "summaries");
+
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+
+    // Без глобальной иерархии в a.cpp наследников не видно.
+    RunOptions Options;
+    ASSERT_EQ(runRefactor(DB, {User}, Options), 0);
+    EXPECT_EQ(readFile(Header).find("virtual"), std::string::npos);
+
+    // Фаза 1: сводки по всем TU, исходники не меняются.
+    Options.EmitHierarchyDir = std::string(SummaryDir);
+    ASSERT_EQ(runRefactor(DB, {User, Derived}, Options), 0);
+    EXPECT_EQ(readFile(Header).find("virtual"), std::string::npos);
+
+    // Фаза 2: объединяем сводки и применяем исправления. --header-filter не задан:
+    // с иерархией заголовок базы всё равно правится.
+    GlobalHierarchy Hierarchy;
+    ASSERT_FALSE(bool(Hierarchy.loadDirectory(SummaryDir)));
+    Options.EmitHierarchyDir.clear();
+    Options.Refactor.Hierarchy = &Hierarchy;
+    ASSERT_EQ(runRefactor(DB, {User}, Options), 0);
+    EXPECT_NE(readFile(Header).find("virtual ~Base()"), std::string::npos);
+}
+
+TEST(ResultCache, SecondRunOverUntouchedTreeHits)
+{
+    TempTree Tree;
+    auto File = Tree.add("cached.cpp", kSource);
+    llvm::SmallString<128> CacheDir(Tree.root());
+    llvm::sys::path::append(CacheDir, "cache");
+
+    RunOptions Options;
+    Options.CacheDir = std::string(CacheDir);
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File}, Options), 0);
+    ASSERT_EQ(readFile(File), kExpected);
+
+    // Для исправленного содержимого уже есть запись с пустым списком правок.
+    ResultCache Cache(Options.CacheDir);
+    auto Key = ResultCache::computeKey(DB.getCompileCommands(File), readFile(File),
+                                       Options.Refactor.fingerprint());
+    auto Edits = Cache.lookup(Key);
+    ASSERT_TRUE(Edits.has_value());
+    EXPECT_TRUE(Edits->empty());
+    EXPECT_EQ(Cache.hits(), 1u);
+
+    ASSERT_EQ(runRefactor(DB, {File}, Options), 0);
+    EXPECT_EQ(readFile(File), kExpected);
+}
+
+TEST(ResultCache, ReplaysEditsAndTracksIncludedFiles)
+{
+    TempTree Tree;
+    auto Header = Tree.add("dep.h", "struct Heavy { Heavy(){} Heavy(const Heavy&){} };\n");
+    auto File = Tree.add("main.cpp", "#include \"dep.h\"\n");
+    llvm::SmallString<128> CacheDir(Tree.root());
+    llvm::sys::path::append(CacheDir, "cache");
+
+    ResultCache Cache(std::string(CacheDir));
+    std::vector<CompileCommand> Commands = {CompileCommand(Tree.root(), File, {"clang", File}, "")};
+    auto Key = ResultCache::computeKey(Commands, readFile(File), 0);
+    EXPECT_FALSE(Cache.lookup(Key).has_value());
+
+    Cache.store(Key, {File, Header}, {Replacement(File, 0, 0, "// note\n")});
+    auto Edits = Cache.lookup(Key);
+    ASSERT_TRUE(Edits.has_value());
+    ASSERT_EQ(Edits->size(), 1u);
+    EXPECT_EQ((*Edits)[0].getReplacementText(), "// note\n");
+
+    // Ключ не зависит от заголовков, но изменение заголовка делает запись недействительной.
+    Tree.add("dep.h", "struct Heavy { int changed; };\n");
+    EXPECT_FALSE(Cache.lookup(Key).has_value());
+    EXPECT_EQ(Cache.hits(), 1u);
+    EXPECT_EQ(Cache.misses(), 2u);
+
+    // Другие флаги компиляции - другой ключ.
+    std::vector<CompileCommand> Other = {CompileCommand(Tree.root(), File, {"clang", "-DX", File}, "")};
+    EXPECT_NE(ResultCache::computeKey(Other, readFile(File), 0), Key);
+}
+
+TEST(ResultCache, EveryEntryKeepsSharedHeaderEdits)
+{
+    TempTree Tree;
+    Tree.add("shared.h", "#pragma once\nstruct B { virtual void g(); };\nstruct D : B { void g(); };\n");
+    auto First = Tree.add("first.cpp", "#include \"shared.h\"\n");
+    auto Second = Tree.add("second.cpp", "#include \"shared.h\"\n");
+    auto FixesPath = Tree.root() + "/fixes.yaml";
+
+    RunOptions Options;
+    Options.CacheDir = Tree.root() + "/cache";
+    Options.Refactor.HeaderFilter = "shared\\.h$";
+    Options.ExportFixes = FixesPath;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {First, Second}, Options), 0);
+    ASSERT_NE(readFile(FixesPath).find("override"), std::string::npos);
+
+    // Первая TU выпала из списка, вторая берётся из кэша: правка заголовка должна остаться.
+    llvm::sys::fs::remove(FixesPath);
+    ASSERT_EQ(runRefactor(DB, {Second}, Options), 0);
+    EXPECT_NE(readFile(FixesPath).find("override"), std::string::npos);
+}
+
+TEST(EditCollector, MergeDeduplicatesAndReportsConflicts)
+{
+    std::vector<Replacement> All = {
+        Replacement("/b.cpp", 10, 0, "&"),
+        Replacement("/a.cpp", 5, 0, "virtual "),
+        Replacement("/a.cpp", 5, 0, "virtual "), // та же правка из другой TU
+        Replacement("/a.cpp", 5, 0, "inline "),  // другая вставка в ту же точку
+        Replacement("/a.cpp", 20, 4, "auto"),
+        Replacement("/a.cpp", 22, 1, "x"),       // пересекается с предыдущей
+    };
+
+    auto Merged = mergeEdits(All);
+    ASSERT_EQ(Merged.Edits.size(), 3u);
+    EXPECT_EQ(Merged.Edits[0].getFilePath(), "/a.cpp");
+    EXPECT_EQ(Merged.Edits[0].getOffset(), 5u);
+    EXPECT_EQ(Merged.Edits[1].getOffset(), 20u);
+    EXPECT_EQ(Merged.Edits[2].getFilePath(), "/b.cpp");
+    EXPECT_EQ(Merged.Duplicates, 1u);
+    EXPECT_EQ(Merged.Conflicts.size(), 2u);
+
+    // Порядок входа не влияет на результат.
+    std::reverse(All.begin(), All.end());
+    auto Reversed = mergeEdits(All);
+    ASSERT_EQ(Reversed.Edits.size(), Merged.Edits.size());
+    for (size_t i = 0; i < Merged.Edits.size(); ++i)
+        EXPECT_EQ(Reversed.Edits[i], Merged.Edits[i]);
+}
+
+TEST(RefactorRunner, ExportFixesLeavesSourcesUntouched)
+{
+    TempTree Tree;
+    auto First = Tree.add("first.cpp", kSource);
+    auto Second = Tree.add("second.cpp", kSource);
+    llvm::SmallString<128> FixesPath(Tree.root());
+    llvm::sys::path::append(FixesPath, "fixes.yaml");
+
+    RunOptions Options;
+    Options.Jobs = 2;
+    Options.ExportFixes = std::string(FixesPath);
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {First, Second}, Options), 0);
+
+    EXPECT_EQ(readFile(First), kSource);
+    EXPECT_EQ(readFile(Second), kSource);
+
+    auto Yaml = readFile(std::string(FixesPath));
+    TranslationUnitReplacements TUR;
+    llvm::yaml::Input YIn(Yaml);
+    YIn >> TUR;
+    ASSERT_FALSE(YIn.error());
+
+    // По три правки на файл: virtual, override и & в range-for.
+    ASSERT_EQ(TUR.Replacements.size(), 6u);
+    EXPECT_EQ(TUR.Replacements[0].getFilePath(), First);
+    EXPECT_EQ(TUR.Replacements[0].getReplacementText(), "virtual ");
+    EXPECT_EQ(TUR.Replacements[3].getFilePath(), Second);
+
+    // Применение выгруженных правок даёт тот же результат, что и рефакторинг на месте.
+    Replacements Replaces;
+    for (const auto &R : TUR.Replacements)
+        if (R.getFilePath() == First)
+            ASSERT_FALSE(bool(Replaces.add(R)));
+    auto Applied = applyAllReplacements(kSource, Replaces);
+    ASSERT_TRUE(bool(Applied));
+    EXPECT_EQ(*Applied, kExpected);
+}
+
+TEST(RefactorRunner, HeaderFilterEditsSharedHeaderOnce)
+{
+    TempTree Tree;
+    auto Header = Tree.add("common.h", R"cpp(#pragma once
+#include <vector>
+struct Heavy { Heavy(){} Heavy(const Heavy&){} };
+class Base {
+public:
+    virtual void foo() {}
+    ~Base() {}
+};
+class Derived : public Base {
+public:
+    void foo() {}
+};
+inline void touch(const std::vector<Heavy> &v) {
+    for (const Heavy h : v) { (void)h; }
+}
+)cpp");
+    auto Other = Tree.add("other.h", "#pragma once\nclass Lonely { public: ~Lonely() {} };\nclass Child : public Lonely {};\n");
+
+    std::vector<std::string> Files;
+    for (int i = 0; i < 6; ++i)
+        Files.push_back(Tree.add("tu" + std::to_string(i) + ".cpp",
+                                 "#include \"common.h\"\n#include \"other.h\"\n"));
+
+    RunOptions Options;
+    Options.Jobs = 3;
+    Options.Refactor.HeaderFilter = "common\\.h$";
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, Files, Options), 0);
+
+    auto Out = readFile(Header);
+    EXPECT_NE(Out.find("    virtual ~Base() {}"), std::string::npos);
+    EXPECT_NE(Out.find("    void foo() override {}"), std::string::npos);
+    EXPECT_NE(Out.find("for (const Heavy& h : v)"), std::string::npos);
+    EXPECT_EQ(Out.find("override override"), std::string::npos);
+    EXPECT_EQ(Out.find("virtual virtual"), std::string::npos);
+
+    // Заголовок вне фильтра не меняется.
+    EXPECT_EQ(readFile(Other).find("virtual"), std::string::npos);
+}
+
+TEST(RefactorRunner, ValueParamEditsDeclarationInFilteredHeader)
+{
+    // Первое объявление в правимом заголовке: его видят все TU, поэтому сигнатуру можно менять.
+    TempTree Tree;
+    auto Header = Tree.add("api.h", "#pragma once\n#include <string>\nstd::size_t len(std::string s);\n");
+    auto Other = Tree.add("other.h", "#pragma once\n#include <string>\nstd::size_t width(std::string s);\n");
+    auto File = Tree.add("api.cpp", "#include \"api.h\"\n#include \"other.h\"\n"
+                                    "std::size_t len(std::string s) { return s.size(); }\n"
+                                    "std::size_t width(std::string s) { return s.size(); }\n");
+
+    RunOptions Options;
+    Options.Refactor.Checks = {"value-param"};
+    Options.Refactor.HeaderFilter = "api\\.h$";
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File}, Options), 0);
+
+    EXPECT_NE(readFile(Header).find("std::size_t len(const std::string& s);"), std::string::npos);
+    auto Out = readFile(File);
+    EXPECT_NE(Out.find("std::size_t len(const std::string& s) {"), std::string::npos);
+    // Заголовок вне фильтра не правится - и определение тоже.
+    EXPECT_EQ(readFile(Other).find("const"), std::string::npos);
+    EXPECT_NE(Out.find("std::size_t width(std::string s) {"), std::string::npos);
+}
+
+TEST(RefactorRunner, ValueParamMovesInHeaderOnlyWithItsOwnUtility)
+{
+    TempTree Tree;
+    const std::string Holder = "struct Blob { Blob(); Blob(const Blob&); Blob(Blob&&); char Data[256]; };\n"
+                               "struct Holder { Blob B; Holder(Blob b) : B(b) {} };\n";
+    // std::move объявлен в TU до заголовка, но другая TU может включить заголовок без <utility>.
+    auto Bare = Tree.add("bare.h", "#pragma once\n" + Holder);
+    auto Moved = Tree.add("moved.h", "#pragma once\n#include <utility>\nnamespace m {\n" + Holder + "}\n");
+    auto First = Tree.add("first.cpp", "#include <utility>\n#include \"bare.h\"\n");
+    auto Second = Tree.add("second.cpp", "#include \"moved.h\"\n");
+
+    RunOptions Options;
+    Options.Refactor.Checks = {"value-param"};
+    Options.Refactor.HeaderFilter = "\\.h$";
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {First, Second}, Options), 0);
+
+    auto BareOut = readFile(Bare);
+    EXPECT_EQ(BareOut.find("std::move"), std::string::npos) << BareOut;
+    EXPECT_NE(BareOut.find("Holder(const Blob& b) : B(b)"), std::string::npos) << BareOut;
+    EXPECT_NE(readFile(Moved).find("Holder(Blob b) : B(std::move(b))"), std::string::npos);
+}
+
+TEST(RefactorRunner, HeaderEditsSurviveFailedFirstClaimant)
+{
+    TempTree Tree;
+    auto Header = Tree.add("shared.h", "#pragma once\nstruct B { virtual void g(); };\nstruct D : B { void g(); };\n");
+    // Первая TU видит заголовок, но не компилируется: её правки отбрасываются.
+    auto Broken = Tree.add("broken.cpp", "#include \"shared.h\"\nint f( {\n");
+    auto Good = Tree.add("good.cpp", "#include \"shared.h\"\n");
+
+    RunOptions Options;
+    Options.Refactor.HeaderFilter = "shared\\.h$";
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    EXPECT_EQ(runRefactor(DB, {Broken, Good}, Options), 1);
+    EXPECT_NE(readFile(Header).find("void g() override;"), std::string::npos);
+}
+
+TEST(RefactorRunner, HeaderEditsSurviveFailedPreambleAttempt)
+{
+    TempTree Tree, Pch;
+    // Без include guard'а разбор с PCH преамбулы падает, обычный разбор проходит.
+    auto Header = Tree.add("unguarded.h", "struct B { virtual void g(); };\nstruct D : B { void g(); };\n");
+    auto File = Tree.add("tu.cpp", "#include \"unguarded.h\"\nint main() {}\n");
+
+    RunOptions Options;
+    Options.PreambleDir = Pch.root();
+    Options.Refactor.HeaderFilter = "unguarded\\.h$";
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File}, Options), 0);
+    EXPECT_NE(readFile(Header).find("void g() override;"), std::string::npos);
+}
+
+TEST(PreambleCache, SharedPreambleIsBuiltOnce)
+{
+    TempTree Tree, Pch;
+    std::vector<std::string> Files;
+    for (int i = 0; i < 4; ++i)
+        Files.push_back(Tree.add("tu" + std::to_string(i) + ".cpp", kSource));
+
+    RunOptions Options;
+    Options.Jobs = 2;
+    Options.PreambleDir = Pch.root();
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, Files, Options), 0);
+
+    for (const auto &File : Files)
+        EXPECT_EQ(readFile(File), kExpected);
+
+    unsigned PchCount = 0;
+    std::error_code EC;
+    for (llvm::sys::fs::directory_iterator It(Pch.root(), EC), End; It != End && !EC; It.increment(EC))
+        PchCount += llvm::sys::path::extension(It->path()) == ".pch";
+    EXPECT_EQ(PchCount, 1u);
+}
+
+TEST(PreambleCache, FallsBackWhenHeaderHasNoGuard)
+{
+    TempTree Tree, Pch;
+    // Без include guard'а повторное включение после PCH даёт переопределение класса.
+    Tree.add("unguarded.h", "struct Plain { int x; };\n");
+    auto File = Tree.add("tu.cpp", "#include \"unguarded.h\"\n" + kSource);
+
+    RunOptions Options;
+    Options.PreambleDir = Pch.root();
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File}, Options), 0);
+
+    EXPECT_EQ(readFile(File), "#include \"unguarded.h\"\n" + kExpected);
+}
+
+TEST(RefactorRunner, ProfileReportCoversEveryMatcherAndTU)
+{
+    TempTree Tree;
+    std::vector<std::string> Files = {Tree.add("a.cpp", kSource), Tree.add("b.cpp", kSource)};
+    auto ReportPath = Tree.root() + "/profile.json";
+
+    RunOptions Options;
+    Options.Jobs = 2;
+    Options.ProfileReport = ReportPath;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, Files, Options), 0);
+    EXPECT_EQ(readFile(Files[0]), kExpected);
+
+    auto Report = llvm::json::parse(readFile(ReportPath));
+    ASSERT_TRUE(bool(Report)) << llvm::toString(Report.takeError());
+    const auto *Total = Report->getAsObject()->getObject("total");
+    ASSERT_NE(Total, nullptr);
+    EXPECT_EQ(Total->getInteger("tus"), 2);
+
+    std::vector<std::string> Matchers;
+    for (const auto &M : *Total->getArray("matchers"))
+        Matchers.push_back(M.getAsObject()->getString("name")->str());
+    llvm::sort(Matchers);
+    EXPECT_EQ(Matchers, (std::vector<std::string>{"nv-dtor", "override", "range-for-copy", "vector-reserve"}));
+
+    const auto *TUs = Report->getAsObject()->getArray("translation_units");
+    ASSERT_EQ(TUs->size(), 2u);
+    EXPECT_GE((*TUs)[0].getAsObject()->getNumber("seconds"), (*TUs)[1].getAsObject()->getNumber("seconds"));
+}
+
+TEST(RefactorRunner, StatsReportCountsEditsAndSkips)
+{
+    TempTree Tree;
+    // Метод без override в заголовке: без --header-filter правка пропускается.
+    Tree.add("derived.h", "struct B { virtual void g(); };\nstruct D : B { void g(); };\n");
+    auto File = Tree.add("tu.cpp", "#include \"derived.h\"\n" + kSource);
+    auto Broken = Tree.add("broken.cpp", "int f( {\n");
+    auto StatsPath = Tree.root() + "/stats.json";
+
+    RunOptions Options;
+    Options.StatsReport = StatsPath;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    EXPECT_EQ(runRefactor(DB, {File, Broken}, Options), 1);
+
+    auto Report = llvm::json::parse(readFile(StatsPath));
+    ASSERT_TRUE(bool(Report)) << llvm::toString(Report.takeError());
+    const auto *Total = Report->getAsObject()->getObject("total");
+    ASSERT_NE(Total, nullptr);
+    EXPECT_EQ(Total->getObject("tus")->getInteger("parsed"), 1);
+    EXPECT_EQ(Total->getObject("tus")->getInteger("failed"), 1);
+    EXPECT_GT(*Total->getInteger("peak_rss_bytes"), 0);
+    EXPECT_TRUE(Total->getInteger("peak_rss_growth_bytes").has_value());
+    // Журнал нужен только до записи отчёта.
+    EXPECT_FALSE(llvm::sys::fs::exists(StatsPath + ".partial"));
+
+    const auto *TUs = Report->getAsObject()->getArray("translation_units");
+    ASSERT_EQ(TUs->size(), 2u);
+    const auto *TU = (*TUs)[1].getAsObject(); // упорядочены по пути: broken.cpp, tu.cpp
+    EXPECT_EQ(TU->getString("status"), "parsed");
+    EXPECT_GT(*TU->getInteger("decls"), 0);
+    EXPECT_GT(*TU->getInteger("stmts"), 0);
+    EXPECT_GT(*TU->getObject("phases")->getObject("parse")->getNumber("wall"), 0);
+    EXPECT_GE(TU->getObject("matches")->getInteger("override"), 2); // и методы из системных заголовков
+
+    const auto *Edits = TU->getObject("edits");
+    EXPECT_EQ(Edits->getInteger("applied"), 3);
+    EXPECT_EQ(Edits->getObject("skipped")->getInteger("not_main_file"), 1);
+}
+
+TEST(StatsJournal, KeepsFinishedAndStartedTUsUntilRemoved)
+{
+    TempTree Tree;
+    auto ReportPath = Tree.root() + "/stats.json";
+    auto Journal = StatsJournal::create(ReportPath);
+    ASSERT_TRUE(bool(Journal)) << llvm::toString(Journal.takeError());
+
+    TUProfile Done;
+    Done.File = "/src/a.cpp";
+    Done.EditsApplied = 2;
+    (*Journal)->started("/src/a.cpp");
+    (*Journal)->finished(Done);
+    (*Journal)->started("/src/huge.cpp"); // процесс убит во время разбора
+
+    // Строки уже в файле, хотя журнал не закрыт.
+    llvm::SmallVector<llvm::StringRef> Lines;
+    auto Content = readFile(ReportPath + ".partial");
+    llvm::StringRef(Content).trim().split(Lines, '\n');
+    ASSERT_EQ(Lines.size(), 3u);
+    auto Last = llvm::json::parse(Lines[2]);
+    ASSERT_TRUE(bool(Last)) << llvm::toString(Last.takeError());
+    EXPECT_EQ(Last->getAsObject()->getString("file"), "/src/huge.cpp");
+    EXPECT_EQ(Last->getAsObject()->getString("status"), "started");
+    auto Finished = llvm::json::parse(Lines[1]);
+    ASSERT_TRUE(bool(Finished));
+    EXPECT_EQ(Finished->getAsObject()->getString("status"), "parsed");
+    EXPECT_EQ(Finished->getAsObject()->getObject("edits")->getInteger("applied"), 2);
+
+    (*Journal)->remove();
+    EXPECT_FALSE(llvm::sys::fs::exists(ReportPath + ".partial"));
+}
+
+TEST(TUProfile, PeakRSSIsPerTUAfterReset)
+{
+    if (!resetPeakRSS())
+        GTEST_SKIP() << "no /proc/self/clear_refs";
+    uint64_t Before = peakRSSBytes();
+    {
+        // Тяжёлая TU: 64 МиБ, реально занятые и освобождённые.
+        std::vector<char> Heavy(64 << 20, 1);
+        RSSProbe Probe(/*ResetPeak=*/true);
+        Heavy.assign(Heavy.size(), 2);
+        TUProfile P;
+        Probe.finish(P);
+        EXPECT_GE(P.PeakRSS, Before + (32 << 20));
+    }
+    // Лёгкая TU после неё не наследует чужой пик.
+    RSSProbe Probe(/*ResetPeak=*/true);
+    TUProfile P;
+    Probe.finish(P);
+    EXPECT_LT(P.PeakRSS, Before + (32 << 20));
+    EXPECT_LT(P.PeakRSSGrowth, uint64_t(32) << 20);
+}
+
+TEST(RefactorRunner, OnlyEnabledChecksEdit)
+{
+    TempTree Tree;
+    auto File = Tree.add("tu.cpp", kSource);
+
+    RunOptions Options;
+    Options.Refactor.Checks = {"range-for-copy"};
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File}, Options), 0);
+
+    auto Out = readFile(File);
+    EXPECT_NE(Out.find("const Heavy& h"), std::string::npos);
+    EXPECT_EQ(Out.find("virtual ~Base"), std::string::npos);
+    EXPECT_EQ(Out.find("override"), std::string::npos);
+}
+
+TEST(RefactorChecks, ParseCheckList)
+{
+    auto All = parseCheckList("");
+    ASSERT_TRUE(bool(All));
+    EXPECT_TRUE(All->empty());
+
+    auto Some = parseCheckList(" override, nv-dtor,override ");
+    ASSERT_TRUE(bool(Some));
+    EXPECT_EQ(*Some, (std::vector<std::string>{"override", "nv-dtor"}));
+
+    auto Unknown = parseCheckList("override,no-such-check");
+    ASSERT_FALSE(bool(Unknown));
+    EXPECT_NE(llvm::toString(Unknown.takeError()).find("no-such-check"), std::string::npos);
+}
+
+TEST(Sharding, ShardsPartitionFilesBySize)
+{
+    TempTree Tree;
+    std::vector<std::string> Files;
+    for (int i = 0; i < 7; ++i)
+        Files.push_back(Tree.add("f" + std::to_string(i) + ".cpp", std::string(100 * (i + 1), ' ')));
+
+    auto Spec = parseShardSpec("1/3");
+    ASSERT_TRUE(bool(Spec));
+    EXPECT_EQ(Spec->Index, 1u);
+    EXPECT_EQ(Spec->Count, 3u);
+    EXPECT_FALSE(bool(parseShardSpec("3/3")));
+    llvm::consumeError(parseShardSpec("3/3").takeError());
+
+    std::vector<std::string> Reversed(Files.rbegin(), Files.rend());
+    std::vector<std::string> Seen;
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        auto Shard = selectShard(Files, {i, 3});
+        EXPECT_EQ(Shard, selectShard(Reversed, {i, 3})); // порядок аргументов не важен
+        Seen.insert(Seen.end(), Shard.begin(), Shard.end());
+    }
+    llvm::sort(Seen);
+    EXPECT_EQ(Seen, Files);
+    // По убыванию размера в наименее загруженный шард: 700+200+100 | 600+300 | 500+400.
+    EXPECT_EQ(selectShard(Files, {0, 3}), (std::vector<std::string>{Files[0], Files[1], Files[6]}));
+    EXPECT_EQ(selectShard(Files, {1, 3}), (std::vector<std::string>{Files[2], Files[5]}));
+}
+
+TEST(Sharding, MergedShardsMatchSingleProcessExport)
+{
+    TempTree Tree;
+    // Правка в общем заголовке получается в каждом шарде и схлопывается при объединении.
+    Tree.add("shared.h", "struct SB { virtual void g(); };\nstruct SD : SB { void g(); };\n");
+    std::vector<std::string> Files;
+    for (int i = 0; i < 5; ++i)
+        Files.push_back(Tree.add("tu" + std::to_string(i) + ".cpp", "#include \"shared.h\"\n" + kSource));
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+
+    RunOptions Single;
+    Single.ExportFixes = Tree.root() + "/single.yaml";
+    Single.Refactor.HeaderFilter = "shared\\.h$";
+    ASSERT_EQ(runRefactor(DB, Files, Single), 0);
+
+    std::vector<std::string> Outputs;
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        RunOptions Shard = Single;
+        Shard.Jobs = 2;
+        Shard.ExportFixes = Tree.root() + "/shard" + std::to_string(i) + ".yaml";
+        Shard.ExportUnmerged = true;
+        ASSERT_EQ(runRefactor(DB, selectShard(Files, {i, 3}), Shard), 0);
+        Outputs.push_back(Shard.ExportFixes);
+    }
+    auto Merged = Tree.root() + "/merged.yaml";
+    ASSERT_EQ(mergeShardFixes(Outputs, Merged, /*Apply=*/false), 0);
+
+    EXPECT_EQ(readFile(Merged), readFile(Single.ExportFixes));
+    EXPECT_EQ(readFile(Files[0]), "#include \"shared.h\"\n" + kSource); // исходники не тронуты
+}
+
+TEST(LexicalPrefilter, LooksForWholeTokens)
+{
+    RefactorOptions Options;
+    Options.Checks = {"range-for-copy"};
+    LexicalPrefilter Filter(Options);
+    ASSERT_TRUE(Filter.enabled());
+    EXPECT_FALSE(Filter.mayProduceEdits("int format(int forward) { return forward; } // fork\n"));
+    EXPECT_TRUE(Filter.mayProduceEdits("void f(int *p) { for(;;) {} }"));
+    // Ключевое слово, разорванное склейкой строк, по тексту не найти - такой файл не фильтруется.
+    EXPECT_TRUE(Filter.mayProduceEdits("void f() { fo\\\nr(;;) {} }"));
+
+    Options.Checks = {"nv-dtor"};
+    EXPECT_TRUE(LexicalPrefilter(Options).mayProduceEdits("struct S { compl S(); };"));
+    EXPECT_FALSE(LexicalPrefilter(Options).mayProduceEdits("int x = 1;"));
+
+    // push_back может прийти из макроса заголовка: vector-reserve ищет только цикл.
+    Options.Checks = {"vector-reserve"};
+    EXPECT_TRUE(LexicalPrefilter(Options).mayProduceEdits(
+        "#include \"append.h\"\nvoid f(std::vector<int> &v) { for (int i = 0; i < 3; ++i) APPEND(v, i); }"));
+    EXPECT_FALSE(LexicalPrefilter(Options).mayProduceEdits("void f(std::vector<int> &v) { v.push_back(1); }"));
+
+    Options.Checks = {"none"};
+    EXPECT_FALSE(LexicalPrefilter(Options).mayProduceEdits(kSource));
+
+    // value-param включается только явно и лексем не имеет: с ней фильтр не действует.
+    Options.Checks.clear();
+    EXPECT_TRUE(LexicalPrefilter(Options).enabled());
+    Options.Checks = {"override", "value-param"};
+    EXPECT_FALSE(LexicalPrefilter(Options).enabled());
+
+    // Правки в заголовках фильтр не видит.
+    Options.Checks.clear();
+    Options.HeaderFilter = ".*";
+    EXPECT_FALSE(LexicalPrefilter(Options).enabled());
+    EXPECT_TRUE(LexicalPrefilter(Options).mayProduceEdits("int x = 1;"));
+}
+
+TEST(RefactorRunner, PrefilterSkipsTUsWithoutCandidates)
+{
+    TempTree Tree;
+    auto File = Tree.add("tu.cpp", kSource);
+    // Тяжёлый заголовок без лексем в главном файле: разбирать незачем.
+    auto Plain = Tree.add("plain.cpp", "#include <vector>\nint sum(const std::vector<int> &v) { return v.size(); }\n");
+    auto StatsPath = Tree.root() + "/stats.json";
+
+    RunOptions Options;
+    Options.Prefilter = true;
+    Options.StatsReport = StatsPath;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File, Plain}, Options), 0);
+    EXPECT_EQ(readFile(File), kExpected);
+
+    auto Report = llvm::json::parse(readFile(StatsPath));
+    ASSERT_TRUE(bool(Report)) << llvm::toString(Report.takeError());
+    const auto *TUs = Report->getAsObject()->getObject("total")->getObject("tus");
+    EXPECT_EQ(TUs->getInteger("parsed"), 1);
+    EXPECT_EQ(TUs->getInteger("prefiltered"), 1);
+}
+
+TEST(RefactorRunner, LimitTraversalKeepsEditsAndSkipsHeaders)
+{
+    TempTree Tree;
+    // Наследник из заголовка: индекс иерархии по-прежнему строится по всей TU.
+    Tree.add("leaf.h", "struct Leaf : Root {};\n");
+    const std::string Code = "struct Root { ~Root() {} };\n#include \"leaf.h\"\n" + kSource;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+
+    auto runWith = [&](bool Limit, const std::string &Name)
+    {
+        auto File = Tree.add(Name + ".cpp", Code);
+        RunOptions Options;
+        Options.Refactor.LimitTraversal = Limit;
+        Options.StatsReport = Tree.root() + "/" + Name + ".json";
+        EXPECT_EQ(runRefactor(DB, {File}, Options), 0);
+        auto Report = llvm::json::parse(readFile(Options.StatsReport));
+        EXPECT_TRUE(bool(Report));
+        auto *TU = (*Report->getAsObject()->getArray("translation_units"))[0].getAsObject();
+        return std::make_pair(readFile(File), *TU->getInteger("decls"));
+    };
+    auto [Full, FullDecls] = runWith(false, "full");
+    auto [Limited, LimitedDecls] = runWith(true, "limited");
+
+    EXPECT_EQ(Full, "struct Root { virtual ~Root() {} };\n#include \"leaf.h\"\n" + kExpected);
+    EXPECT_EQ(Limited, Full);
+    // Объявления <vector> в обход больше не попадают.
+    EXPECT_LT(LimitedDecls * 10, FullDecls);
+}
+
+TEST(IncludeGraph, OnlyTUsIncludingChangedFilesAreAffected)
+{
+    TempTree Tree;
+    auto HeaderA = Tree.add("a.h", "struct A {};\n");
+    Tree.add("b.h", "struct B {};\n");
+    auto UsesA = Tree.add("uses_a.cpp", "#include \"a.h\"\nA a;\n");
+    auto UsesB = Tree.add("uses_b.cpp", "#include \"b.h\"\nB b;\n");
+    auto Plain = Tree.add("plain.cpp", "int x;\n");
+    auto GraphPath = Tree.root() + "/graph.json";
+
+    RunOptions Options;
+    Options.IncludeGraphPath = GraphPath;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {UsesA, UsesB, Plain}, Options), 0);
+
+    auto Graph = IncludeGraph::load(GraphPath);
+    ASSERT_TRUE(bool(Graph)) << llvm::toString(Graph.takeError());
+    EXPECT_EQ(Graph->size(), 3u);
+
+    // TU, которой ещё нет в графе, разбирается всегда.
+    auto New = Tree.add("new.cpp", "int y;\n");
+    std::vector<std::string> All = {UsesA, UsesB, Plain, New};
+    EXPECT_EQ(Graph->affected(All, {HeaderA}, DB), (std::vector<std::string>{UsesA, New}));
+    EXPECT_EQ(Graph->affected(All, {Plain}, DB), (std::vector<std::string>{Plain, New}));
+    EXPECT_EQ(Graph->affected(All, {}, DB), (std::vector<std::string>{New}));
+
+    // Другие флаги компиляции - другой результат у всех TU.
+    FixedCompilationDatabase Changed(Tree.root(), {"-std=c++17"});
+    EXPECT_EQ(Graph->affected(All, {}, Changed), All);
+}
+
+TEST(GitChanges, ListsModifiedAndUntrackedFiles)
+{
+    auto Git = llvm::sys::findProgramByName("git");
+    if (!Git)
+        GTEST_SKIP() << "git not found";
+
+    TempTree Tree;
+    auto Kept = Tree.add("kept.h", "struct K {};\n");
+    auto Edited = Tree.add("edited.h", "struct E {};\n");
+    std::string Root = Tree.root();
+    auto git = [&](std::vector<llvm::StringRef> Args)
+    {
+        std::vector<llvm::StringRef> Argv = {*Git, "-C", Root, "-c", "user.name=test", "-c",
+                                             "user.email=test@example.com"};
+        Argv.insert(Argv.end(), Args.begin(), Args.end());
+        return llvm::sys::ExecuteAndWait(*Git, Argv);
+    };
+    ASSERT_EQ(git({"init", "-q"}), 0);
+    ASSERT_EQ(git({"add", "."}), 0);
+    ASSERT_EQ(git({"commit", "-q", "-m", "init"}), 0);
+
+    Tree.add("edited.h", "struct E { int x; };\n");
+    auto Added = Tree.add("added.h", "struct N {};\n");
+
+    auto Changed = gitChangedFiles("HEAD", Root);
+    ASSERT_TRUE(bool(Changed)) << llvm::toString(Changed.takeError());
+    std::vector<std::string> Canonical;
+    for (const auto &File : *Changed)
+        Canonical.push_back(IncludeGraph::canonicalPath(File));
+    EXPECT_TRUE(llvm::is_contained(Canonical, IncludeGraph::canonicalPath(Edited)));
+    EXPECT_TRUE(llvm::is_contained(Canonical, IncludeGraph::canonicalPath(Added)));
+    EXPECT_FALSE(llvm::is_contained(Canonical, IncludeGraph::canonicalPath(Kept)));
+
+    auto Option = gitChangedFiles("--output=x", Root); // ревизия не передаётся git'у как опция
+    EXPECT_FALSE(bool(Option));
+    llvm::consumeError(Option.takeError());
+}
+
+TEST(ProfileData, ReadsInstrumentedAndSampledText)
+{
+    TempTree Tree;
+    auto Instr = Tree.add("instr.proftext", "# IR level Instrumentation Flag\n:ir\n"
+                                            "hot\n# Func Hash:\n1\n# Num Counters:\n2\n# Counter Values:\n1000\n5000\n\n"
+                                            "a.cpp;_ZL5localv\n# Func Hash:\n2\n# Num Counters:\n1\n# Counter Values:\n7\n");
+    auto Counts = FunctionProfile::load(Instr);
+    ASSERT_TRUE(bool(Counts)) << llvm::toString(Counts.takeError());
+    EXPECT_EQ(Counts->count("hot"), 5000u); // самый горячий блок
+    EXPECT_EQ(Counts->count("_ZL5localv"), 7u);
+    EXPECT_EQ(Counts->count("missing"), 0u);
+
+    auto Sampled = Tree.add("perf.prof", "hot:300:10\n 1: 300\n 2: 20 callee:20\nhot.llvm.42:5:0\ncold:7:1\n");
+    auto Samples = FunctionProfile::load(Sampled);
+    ASSERT_TRUE(bool(Samples)) << llvm::toString(Samples.takeError());
+    EXPECT_EQ(Samples->count("hot"), 305u);
+    EXPECT_EQ(Samples->count("cold"), 7u);
+    EXPECT_EQ(Samples->count("callee"), 0u); // вызовы внутри тела - не записи функций
+}
+
+TEST(TUScheduler, LongestTUsGoFirst)
+{
+    TempTree Tree;
+    auto Small = Tree.add("small.cpp", "int x;\n");
+    auto Big = Tree.add("big.cpp", std::string(4096, ' ') + "int y;\n");
+    auto Heavy = Tree.add("heavy.cpp", "#include <vector>\n#include <map>\nint z;\n");
+    auto TieB = Tree.add("tie_b.cpp", "int t;\n");
+    auto TieA = Tree.add("tie_a.cpp", "int t;\n");
+
+    // Без истории: #include весит больше размера, одинаковые - по пути.
+    EXPECT_EQ(scheduleLargestFirst({Small, TieB, Big, TieA, Heavy}, nullptr),
+              (std::vector<std::string>{Heavy, Big, Small, TieA, TieB}));
+
+    // История важнее оценки: маленькая, но долгая TU идёт первой.
+    TimingHistory History;
+    History.record(Small, 30);
+    History.record(Heavy, 1);
+    EXPECT_EQ(scheduleLargestFirst({Heavy, Big, Small}, &History).front(), Small);
+
+    auto Path = Tree.root() + "/timings.json";
+    ASSERT_FALSE(bool(History.save(Path)));
+    auto Loaded = TimingHistory::load(Path);
+    ASSERT_TRUE(bool(Loaded)) << llvm::toString(Loaded.takeError());
+    EXPECT_EQ(Loaded->size(), 2u);
+    EXPECT_EQ(Loaded->seconds(Small), 30.0);
+    Loaded->record(Small, 10);
+    EXPECT_EQ(Loaded->seconds(Small), 20.0); // среднее с прошлым запуском
+    EXPECT_FALSE(Loaded->seconds(Big).has_value());
+}
+
+TEST(RefactorRunner, TimingsFileRecordsParsedTUs)
+{
+    TempTree Tree;
+    auto A = Tree.add("a.cpp", "int a;\n");
+    auto B = Tree.add("b.cpp", "int b;\n");
+    RunOptions Options;
+    Options.Jobs = 2;
+    Options.TimingsFile = Tree.root() + "/timings.json";
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {A, B}, Options), 0);
+
+    auto History = TimingHistory::load(Options.TimingsFile);
+    ASSERT_TRUE(bool(History)) << llvm::toString(History.takeError());
+    EXPECT_TRUE(History->seconds(A).has_value());
+    EXPECT_TRUE(History->seconds(B).has_value());
+}
+
+TEST(RefactorRunner, ProfileThresholdKeepsOnlyHotLoops)
+{
+    TempTree Tree;
+    const std::string Code = R"cpp(
+#include <vector>
+struct Heavy { Heavy(){} Heavy(const Heavy&){} char Data[64]; };
+extern "C" void hot(const std::vector<Heavy> &v) { for (const Heavy h : v) { (void)h; } }
+extern "C" void warm(const Heavy (&a)[4]) { for (const Heavy h : a) { (void)h; } }
+extern "C" void unknown(const std::vector<Heavy> &v) { for (const Heavy h : v) { (void)h; } }
+)cpp";
+    auto File = Tree.add("tu.cpp", Code);
+    auto ProfilePath = Tree.add("perf.prof", "hot:5000:5000\nwarm:10:10\n");
+    auto RankingPath = Tree.root() + "/ranking.tsv";
+
+    auto Counts = FunctionProfile::load(ProfilePath);
+    ASSERT_TRUE(bool(Counts));
+    RunOptions Options;
+    Options.Refactor.Checks = {"range-for-copy"};
+    Options.Refactor.ProfileData = &*Counts;
+    Options.Refactor.ProfileThreshold = 1000; // warm: 10 x 64 байта x 4 итерации = 2560
+    Options.ProfileRanking = RankingPath;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    ASSERT_EQ(runRefactor(DB, {File}, Options), 0);
+
+    auto Out = readFile(File);
+    EXPECT_NE(Out.find("hot(const std::vector<Heavy> &v) { for (const Heavy& h"), std::string::npos);
+    EXPECT_NE(Out.find("warm(const Heavy (&a)[4]) { for (const Heavy& h"), std::string::npos);
+    EXPECT_NE(Out.find("unknown(const std::vector<Heavy> &v) { for (const Heavy h"), std::string::npos);
+
+    llvm::SmallVector<llvm::StringRef> Lines;
+    auto Ranking = readFile(RankingPath);
+    llvm::StringRef(Ranking).split(Lines, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    ASSERT_EQ(Lines.size(), 4u); // заголовок и три кандидата
+    EXPECT_TRUE(Lines[1].starts_with("320000\t5000\t64\t?\t"));
+    EXPECT_TRUE(Lines[1].ends_with("\thot\tapplied"));
+    EXPECT_TRUE(Lines[2].starts_with("2560\t10\t64\t4\t"));
+    EXPECT_TRUE(Lines[3].ends_with("\tunknown\tskipped"));
+}
+
+TEST(RefactorRunner, RankingKeepsOnlyAcceptedTUs)
+{
+    TempTree Tree, Pch;
+    const std::string Loop = "#include <vector>\nstruct Heavy { Heavy(){} Heavy(const Heavy&){} };\n"
+                             "extern \"C\" void hot(const std::vector<Heavy> &v) { for (const Heavy h : v) { (void)h; } }\n";
+    // TU с ошибкой: её кандидат в список не попадает.
+    auto Broken = Tree.add("broken.cpp", Loop + "int f( {\n");
+    // Разбор с PCH преамбулы падает (нет include guard'а), обычный проходит: кандидат один.
+    Tree.add("unguarded.h", "struct Plain { int x; };\n");
+    auto Retried = Tree.add("retried.cpp", "#include \"unguarded.h\"\n" + Loop);
+    auto ProfilePath = Tree.add("perf.prof", "hot:5000:5000\n");
+    auto RankingPath = Tree.root() + "/ranking.tsv";
+
+    auto Counts = FunctionProfile::load(ProfilePath);
+    ASSERT_TRUE(bool(Counts));
+    RunOptions Options;
+    Options.Refactor.Checks = {"range-for-copy"};
+    Options.Refactor.ProfileData = &*Counts;
+    Options.ProfileRanking = RankingPath;
+    Options.PreambleDir = Pch.root();
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    EXPECT_EQ(runRefactor(DB, {Broken, Retried}, Options), 1);
+
+    llvm::SmallVector<llvm::StringRef> Lines;
+    auto Ranking = readFile(RankingPath);
+    llvm::StringRef(Ranking).split(Lines, '\n', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    ASSERT_EQ(Lines.size(), 2u) << Ranking; // заголовок и кандидат из retried.cpp
+    EXPECT_NE(Lines[1].find("retried.cpp:"), llvm::StringRef::npos);
+    EXPECT_TRUE(Lines[1].ends_with("\thot\tapplied"));
+}
+
+TEST(RefactorServer, ServesRequestsUntilShutdown)
+{
+    TempTree Tree;
+    auto First = Tree.add("first.cpp", kSource);
+    auto Second = Tree.add("second.cpp", kSource);
+    auto Socket = Tree.root() + "/refactor.sock";
+
+    RunOptions Options;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    int ServerResult = -1;
+    std::thread Server([&]
+                       { ServerResult = serveRefactor(DB, Options, Socket, {}, /*Watch=*/true, 50); });
+    for (int i = 0; i < 500 && !llvm::sys::fs::exists(Socket); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    EXPECT_EQ(requestRefactor(Socket, {First}), 0);
+    EXPECT_EQ(readFile(First), kExpected);
+    EXPECT_EQ(readFile(Second), kSource);
+
+    // Второй запрос использует тёплый PCH преамбулы <vector>.
+    EXPECT_EQ(requestRefactor(Socket, {Second}), 0);
+    EXPECT_EQ(readFile(Second), kExpected);
+
+    EXPECT_EQ(requestShutdown(Socket), 0);
+    Server.join();
+    EXPECT_EQ(ServerResult, 0);
+}
+
+TEST(RefactorServer, SilentClientDoesNotBlockServer)
+{
+    TempTree Tree;
+    auto Socket = Tree.root() + "/refactor.sock";
+
+    RunOptions Options;
+    FixedCompilationDatabase DB(Tree.root(), {"-std=c++20"});
+    int ServerResult = -1;
+    std::thread Server([&]
+                       { ServerResult = serveRefactor(DB, Options, Socket, {}, /*Watch=*/false, 50,
+                                                      /*ReadTimeoutMs=*/200); });
+    for (int i = 0; i < 500 && !llvm::sys::fs::exists(Socket); ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // Подключился и молчит, соединение не закрывает.
+    auto Silent = llvm::raw_socket_stream::createConnectedUnix(Socket);
+    ASSERT_TRUE(bool(Silent)) << llvm::toString(Silent.takeError());
+    **Silent << "{\"files\": [";
+    (*Silent)->flush();
+
+    EXPECT_EQ(requestShutdown(Socket), 0);
+    Server.join();
+    EXPECT_EQ(ServerResult, 0);
+}